@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Arena.hpp"
+
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+using DKIM::Arena;
+
+Arena::Arena()
+: m_current(m_initial)
+, m_available(sizeof(m_initial))
+, m_blocks(nullptr)
+, m_used(0)
+, m_blockSize(sizeof(m_initial))
+{
+}
+
+Arena::~Arena()
+{
+	FreeBlocks();
+}
+
+/*
+ * Reset()
+ *
+ * Start over from the initial buffer. If the last message needed more
+ * than one heap block they are replaced by one of their total size, the
+ * next message of that size fits in it.
+ */
+void Arena::Reset()
+{
+	if (m_blocks && m_blocks->next)
+	{
+		size_t size = 0;
+		for (Block* block = m_blocks; block; block = block->next)
+			size += block->size;
+		FreeBlocks();
+
+		Block* block = (Block*)malloc(sizeof(Block) + size);
+		if (block)
+		{
+			block->next = nullptr;
+			block->size = size;
+			m_blocks = block;
+			m_blockSize = size;
+		}
+	}
+	m_current = m_initial;
+	m_available = sizeof(m_initial);
+	m_used = 0;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment)
+{
+	while (true)
+	{
+		size_t padding = (alignment - (size_t)m_current % alignment) % alignment;
+		if (padding + bytes <= m_available)
+		{
+			void* ptr = m_current + padding;
+			m_current += padding + bytes;
+			m_available -= padding + bytes;
+			return ptr;
+		}
+
+		// the blocks in use are first in the list, then those kept by Reset()
+		Block* next = m_blocks;
+		for (size_t i = 0; next && i < m_used; ++i)
+			next = next->next;
+		if (!next || next->size < bytes + alignment)
+		{
+			size_t size = std::max(bytes + alignment, m_blockSize * 2);
+			Block* block = (Block*)malloc(sizeof(Block) + size);
+			if (!block)
+				throw std::bad_alloc();
+			block->size = size;
+			m_blockSize = size;
+
+			// insert it after the blocks in use
+			Block** link = &m_blocks;
+			for (size_t i = 0; *link && i < m_used; ++i)
+				link = &(*link)->next;
+			block->next = *link;
+			*link = block;
+			next = block;
+		}
+		m_current = (char*)(next + 1);
+		m_available = next->size;
+		++m_used;
+	}
+}
+
+void Arena::FreeBlocks()
+{
+	while (m_blocks)
+	{
+		Block* next = m_blocks->next;
+		free(m_blocks);
+		m_blocks = next;
+	}
+}
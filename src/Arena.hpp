@@ -0,0 +1,81 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_ARENA_HPP_
+#define _DKIM_ARENA_HPP_
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace DKIM
+{
+	/*
+	 * Monotonic memory for the parse state of one message (the Message,
+	 * its Signatures and TagLists); allocations are never freed one by
+	 * one, all memory is released at once when the arena is destroyed.
+	 * The first InitialSize bytes are kept in the arena itself, larger
+	 * messages take blocks from the heap.
+	 *
+	 * Reset() makes all memory available again but keeps the blocks, so
+	 * that an arena reused for messages of similar size stops allocating;
+	 * nothing allocated from it may be used after that.
+	 *
+	 * As the objects allocating from it, an arena is not thread-safe.
+	 */
+	class Arena : public std::pmr::memory_resource
+	{
+		public:
+			static const size_t InitialSize = 4096;
+
+			Arena();
+			~Arena();
+
+			void Reset();
+
+			std::pmr::memory_resource* GetResource()
+			{ return this; }
+		private:
+			Arena(const Arena&);
+			Arena& operator=(const Arena&);
+
+			void* do_allocate(size_t bytes, size_t alignment) override;
+			void do_deallocate(void*, size_t, size_t) override
+			{ }
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+			{ return this == &other; }
+
+			void FreeBlocks();
+
+			struct Block
+			{
+				Block* next;
+				size_t size;
+			};
+
+			alignas(std::max_align_t) char m_initial[InitialSize];
+			char* m_current;
+			size_t m_available;
+			Block* m_blocks;
+			size_t m_used;
+			size_t m_blockSize;
+	};
+}
+
+#endif
@@ -19,51 +19,170 @@
  *
  */
 #include "Base64.hpp"
+#include "Util.hpp"
 #include "Exception.hpp"
 
-#include <openssl/bio.h>
-#include <openssl/evp.h>
-#include <openssl/buffer.h>
+#include <cstdint>
 
-std::string DKIM::Conversion::Base64_Decode(const std::string& data)
+using DKIM::Util::StringFormat;
+
+namespace {
+	const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	enum {
+		B64_WSP = 0x40,		// skipped anywhere
+		B64_PAD = 0x41,		// '=', at the end of the last quantum
+		B64_INVALID = 0xff,
+	};
+
+	// the value of a character, or one of the above; all but the
+	// values of the alphabet have one of the 0xc0 bits set
+	struct DecodeTable
+	{
+		uint8_t values[256];
+		constexpr DecodeTable()
+		: values()
+		{
+			for (int c = 0; c < 256; ++c)
+				values[c] = B64_INVALID;
+			for (int v = 0; v < 64; ++v)
+				values[(unsigned char)alphabet[v]] = (uint8_t)v;
+			values[(unsigned char)' '] = B64_WSP;
+			values[(unsigned char)'\t'] = B64_WSP;
+			values[(unsigned char)'\r'] = B64_WSP;
+			values[(unsigned char)'\n'] = B64_WSP;
+			values[(unsigned char)'='] = B64_PAD;
+		}
+	};
+
+	constexpr DecodeTable decode;
+
+	[[noreturn]] void Unexpected(std::string_view data, size_t i)
+	{
+		throw DKIM::PermanentError(StringFormat("Invalid base64 data, unexpected 0x%x at position %ld",
+					(unsigned char)data[i],
+					(ssize_t)i
+					)
+				);
+	}
+}
+
+/*
+ * Base64_Decode()
+ *
+ * Four characters at a time while there is no whitespace or padding, and
+ * one at a time around them
+ */
+size_t DKIM::Conversion::Base64_Decode(std::string_view data, char* out)
 {
-	BIO *i, *o, *l;
-	i = BIO_new(BIO_f_base64());
-	BIO_set_flags(i, BIO_FLAGS_BASE64_NO_NL);
-	o = BIO_new(BIO_s_mem());
-	l = BIO_push(i, o);
-	BIO_write(o, data.c_str(), data.size());
-	(void) BIO_flush(o);
-
-	char b[1024];
-	int r;
-	std::string result;
-	while ((r = BIO_read(l, b, sizeof b)) > 0)
-		result.append(b, (size_t)r);
-
-	BIO_free_all(l);
-	return result;
+	const unsigned char* in = (const unsigned char*)data.data();
+	const size_t size = data.size();
+	char* begin = out;
+
+	uint32_t quantum = 0;
+	size_t count = 0;
+	size_t padding = 0;
+	size_t i = 0;
+	while (i < size)
+	{
+		if (count == 0 && padding == 0)
+		{
+			for (; i + 4 <= size; i += 4)
+			{
+				uint8_t a = decode.values[in[i]];
+				uint8_t b = decode.values[in[i + 1]];
+				uint8_t c = decode.values[in[i + 2]];
+				uint8_t d = decode.values[in[i + 3]];
+				if ((a | b | c | d) & 0xc0)
+					break;
+				uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+				out[0] = (char)(v >> 16);
+				out[1] = (char)(v >> 8);
+				out[2] = (char)v;
+				out += 3;
+			}
+			if (i == size)
+				break;
+		}
+
+		uint8_t v = decode.values[in[i]];
+		if (v == B64_WSP)
+		{
+			++i;
+			continue;
+		}
+		if (v == B64_PAD)
+		{
+			// xx== or xxx=
+			if (count < 2)
+				Unexpected(data, i);
+			++padding;
+			v = 0;
+		}
+		else if (v == B64_INVALID || padding)
+			Unexpected(data, i);
+		++i;
+
+		quantum = quantum << 6 | v;
+		if (++count < 4)
+			continue;
+
+		out[0] = (char)(quantum >> 16);
+		out[1] = (char)(quantum >> 8);
+		out[2] = (char)quantum;
+		out += 3 - padding;
+		quantum = 0;
+		count = 0;
+	}
+
+	if (count != 0)
+		throw DKIM::PermanentError("Invalid base64 data (truncated), at the END");
+
+	return (size_t)(out - begin);
 }
 
-std::string DKIM::Conversion::Base64_Encode(const std::string& data)
+size_t DKIM::Conversion::Base64_Encode(std::string_view data, char* out)
 {
-	BIO *i, *o, *l;
-	i = BIO_new(BIO_f_base64());
-	o = BIO_new(BIO_s_mem());
-	l = BIO_push(i, o);
-	BIO_set_flags(l, BIO_FLAGS_BASE64_NO_NL);
-	BIO_write(l, data.c_str(), data.size());
-	(void) BIO_flush(l);
-	std::string str;
-
-	char buf[256];
-	int r;
-	while ((r = BIO_read(o, buf, sizeof buf)) > 0)
+	const unsigned char* in = (const unsigned char*)data.data();
+	const size_t size = data.size();
+	char* begin = out;
+
+	size_t i = 0;
+	for (; i + 3 <= size; i += 3)
+	{
+		uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+		out[0] = alphabet[v >> 18];
+		out[1] = alphabet[(v >> 12) & 63];
+		out[2] = alphabet[(v >> 6) & 63];
+		out[3] = alphabet[v & 63];
+		out += 4;
+	}
+
+	if (i < size)
 	{
-		if (buf[r - 1] == '\n') --r;
-		str.append(buf, (size_t)r);
+		uint32_t v = (uint32_t)in[i] << 16;
+		if (i + 1 < size)
+			v |= (uint32_t)in[i + 1] << 8;
+		out[0] = alphabet[v >> 18];
+		out[1] = alphabet[(v >> 12) & 63];
+		out[2] = i + 1 < size ? alphabet[(v >> 6) & 63] : '=';
+		out[3] = '=';
+		out += 4;
 	}
 
-	BIO_free_all(l);
-	return str;
+	return (size_t)(out - begin);
+}
+
+std::string DKIM::Conversion::Base64_Decode(std::string_view data)
+{
+	std::string result(Base64_DecodedSize(data.size()), '\0');
+	result.resize(Base64_Decode(data, &result[0]));
+	return result;
+}
+
+std::string DKIM::Conversion::Base64_Encode(std::string_view data)
+{
+	std::string result(Base64_EncodedSize(data.size()), '\0');
+	result.resize(Base64_Encode(data, &result[0]));
+	return result;
 }
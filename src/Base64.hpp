@@ -22,11 +22,31 @@
 #define _DKIM_BASE64_HPP_
 
 #include <string>
+#include <string_view>
 
 namespace DKIM {
 	namespace Conversion {
-		std::string Base64_Decode(const std::string& data);
-		std::string Base64_Encode(const std::string& data);
+		/*
+		 * Base64 (RFC 4648) without line breaks. Decoding skips the
+		 * whitespace of FWS (SP, HTAB, CR and LF, not VT or FF) and throws
+		 * DKIM::PermanentError at the first character that is not valid,
+		 * or if the data ends within a quantum (padding is required).
+		 */
+		std::string Base64_Decode(std::string_view data);
+		std::string Base64_Encode(std::string_view data);
+
+		/*
+		 * The same, into out which has room for at least the size of
+		 * Base64_DecodedSize() or Base64_EncodedSize(); they return the
+		 * number of characters written.
+		 */
+		size_t Base64_Decode(std::string_view data, char* out);
+		size_t Base64_Encode(std::string_view data, char* out);
+
+		constexpr size_t Base64_DecodedSize(size_t size)
+		{ return size / 4 * 3; }
+		constexpr size_t Base64_EncodedSize(size_t size)
+		{ return (size + 2) / 3 * 4; }
 	}
 }
 
@@ -0,0 +1,315 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "BodyHash.hpp"
+#include "Canonicalization.hpp"
+
+#include <algorithm>
+
+using DKIM::Conversion::BodyHash;
+using DKIM::Conversion::BodyCanonicalizer;
+
+BodyHash::BodyHash()
+: m_passCount(0)
+, m_started(false)
+, m_dotStuffed(false)
+, m_lineEnding(DKIM::DKIM_LE_CRLF)
+, m_pipelined(false)
+{
+	for (auto & pass : m_passes)
+	{
+		pass.bodyHash = this;
+		pass.digestCount = 0;
+	}
+}
+
+BodyHash::~BodyHash()
+{
+}
+
+void BodyHash::Reset()
+{
+	m_entries.clear();
+	for (auto & pass : m_passes)
+	{
+		pass.pipeline.reset();
+		pass.canonicalbody.reset();
+	}
+	m_passCount = 0;
+	m_started = false;
+}
+
+std::vector<BodyHash::Entry>::iterator BodyHash::Find(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize)
+{
+	for (auto i = m_entries.begin(); i != m_entries.end(); ++i)
+		if (i->type == type && i->algorithm == algorithm && i->bodyLimit == bodyLimit && (!bodyLimit || i->bodySize == bodySize))
+			return i;
+	return m_entries.end();
+}
+
+std::vector<BodyHash::Entry>::const_iterator BodyHash::Find(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize) const
+{
+	for (auto i = m_entries.begin(); i != m_entries.end(); ++i)
+		if (i->type == type && i->algorithm == algorithm && i->bodyLimit == bodyLimit && (!bodyLimit || i->bodySize == bodySize))
+			return i;
+	return m_entries.end();
+}
+
+void BodyHash::Add(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize)
+{
+	if (Find(type, algorithm, bodyLimit, bodySize) != m_entries.end())
+		return;
+
+	Entry entry;
+	entry.type = type;
+	entry.algorithm = algorithm;
+	entry.bodyLimit = bodyLimit;
+	entry.bodySize = bodyLimit ? bodySize : 0;
+	entry.done = false;
+	entry.hashSize = 0;
+	m_entries.push_back(entry);
+}
+
+/*
+ * SetDotStuffed()
+ *
+ * The body is SMTP DATA that is still dot-stuffed
+ */
+void BodyHash::SetDotStuffed(bool dotStuffed)
+{
+	m_dotStuffed = dotStuffed;
+}
+
+/*
+ * SetLineEnding()
+ *
+ * The line ending of the body (CRLF or LF)
+ */
+void BodyHash::SetLineEnding(LineEnding lineEnding)
+{
+	m_lineEnding = lineEnding;
+}
+
+/*
+ * SetPipelined()
+ *
+ * Hash the body in one thread per digest
+ */
+void BodyHash::SetPipelined(bool pipelined)
+{
+	m_pipelined = pipelined;
+}
+
+bool BodyHash::Get(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize, std::string& hash) const
+{
+	auto i = Find(type, algorithm, bodyLimit, bodySize);
+	if (i == m_entries.end() || !i->done)
+		return false;
+	hash.assign((const char*)i->hash, i->hashSize);
+	return true;
+}
+
+void BodyHash::Finalize(Digest& digest, Entry& entry)
+{
+	// may run in a pipeline thread, without allocating
+	EVP_MD_CTX_copy_ex(digest.snapshot.get(), digest.ctx.get());
+	EVP_DigestFinal_ex(digest.snapshot.get(), entry.hash, &entry.hashSize);
+	entry.done = true;
+}
+
+/*
+ * Begin()
+ *
+ * Set up one pass per canonicalization mode for the pending hashes. Each
+ * pass feeds one digest per algorithm; the entries with a body length
+ * limit are finalized from a copy of it when the limit is reached (in
+ * ascending order), the others when the body ends. The passes and their
+ * digest contexts are kept from the previous body.
+ */
+void BodyHash::Begin()
+{
+	m_passCount = 0;
+	m_started = true;
+
+	const CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+	for (CanonMode type : types)
+	{
+		Pass& pass = m_passes[m_passCount];
+		pass.digestCount = 0;
+		bool bodyLimit = true;
+		size_t bodySize = 0;
+
+		const DigestAlgorithm algorithms[] = { DKIM::DKIM_A_SHA1, DKIM::DKIM_A_SHA256 };
+		for (DigestAlgorithm algorithm : algorithms)
+		{
+			Digest& digest = pass.digests[pass.digestCount];
+			digest.limited.clear();
+			digest.full.clear();
+			digest.next = 0;
+			digest.offset = 0;
+			for (size_t i = 0; i < m_entries.size(); ++i)
+			{
+				const Entry& entry = m_entries[i];
+				if (entry.done || entry.type != type || entry.algorithm != algorithm)
+					continue;
+				if (entry.bodyLimit)
+				{
+					digest.limited.push_back(i);
+					bodySize = std::max(bodySize, entry.bodySize);
+				} else {
+					digest.full.push_back(i);
+					bodyLimit = false;
+				}
+			}
+			if (digest.limited.empty() && digest.full.empty())
+				continue;
+
+			std::sort(digest.limited.begin(), digest.limited.end(), [this] (size_t a, size_t b) {
+				return m_entries[a].bodySize < m_entries[b].bodySize;
+			});
+
+			if (!digest.ctx)
+			{
+				digest.ctx = EVPContext(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
+				digest.snapshot = EVPContext(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
+			}
+			switch (algorithm)
+			{
+				case DKIM::DKIM_A_SHA1:
+					EVP_DigestInit_ex(digest.ctx.get(), EVP_sha1(), nullptr);
+					break;
+				case DKIM::DKIM_A_SHA256:
+					EVP_DigestInit_ex(digest.ctx.get(), EVP_sha256(), nullptr);
+					break;
+			}
+			++pass.digestCount;
+		}
+		if (pass.digestCount == 0)
+			continue;
+
+		if (m_pipelined)
+		{
+			pass.pipeline.reset(new Pipeline);
+			for (size_t i = 0; i < pass.digestCount; ++i)
+			{
+				Digest* d = &pass.digests[i];
+				pass.pipeline->AddConsumer([this, d] (const char* data, size_t size) {
+					FeedDigest(*d, data, size);
+				});
+			}
+		}
+
+		pass.canonicalbody.emplace(type, bodyLimit, bodySize, pass, m_dotStuffed, m_lineEnding);
+		++m_passCount;
+	}
+}
+
+void BodyHash::Feed(Pass& pass, const char* data, size_t size)
+{
+	if (pass.pipeline)
+	{
+		pass.pipeline->Write(data, size);
+		return;
+	}
+	for (size_t i = 0; i < pass.digestCount; ++i)
+		FeedDigest(pass.digests[i], data, size);
+}
+
+void BodyHash::FeedDigest(Digest& digest, const char* data, size_t size)
+{
+	size_t i = 0;
+	while (digest.next < digest.limited.size() && m_entries[digest.limited[digest.next]].bodySize <= digest.offset + size)
+	{
+		Entry& entry = m_entries[digest.limited[digest.next++]];
+		size_t upto = entry.bodySize - digest.offset;
+		EVP_DigestUpdate(digest.ctx.get(), data + i, upto - i);
+		i = upto;
+		Finalize(digest, entry);
+	}
+	EVP_DigestUpdate(digest.ctx.get(), data + i, size - i);
+	digest.offset += size;
+}
+
+void BodyHash::Update(const char* data, size_t size)
+{
+	if (!m_started)
+		Begin();
+	for (size_t i = 0; i < m_passCount; ++i)
+		m_passes[i].canonicalbody->Update(data, size);
+}
+
+bool BodyHash::IsDone() const
+{
+	for (size_t i = 0; i < m_passCount; ++i)
+		if (!m_passes[i].canonicalbody->IsDone())
+			return false;
+	return true;
+}
+
+void BodyHash::Final()
+{
+	if (!m_started)
+		Begin();
+
+	for (size_t p = 0; p < m_passCount; ++p)
+	{
+		Pass& pass = m_passes[p];
+		pass.canonicalbody->Final();
+		if (pass.pipeline)
+			pass.pipeline->Close();
+
+		// limits beyond the end of the body are hashed over the entire body
+		for (size_t d = 0; d < pass.digestCount; ++d)
+		{
+			Digest& digest = pass.digests[d];
+			for (; digest.next < digest.limited.size(); ++digest.next)
+				Finalize(digest, m_entries[digest.limited[digest.next]]);
+			for (auto i : digest.full)
+				Finalize(digest, m_entries[i]);
+		}
+
+		pass.pipeline.reset();
+		pass.canonicalbody.reset();
+	}
+
+	m_passCount = 0;
+	m_started = false;
+}
+
+void BodyHash::Run(std::istream& stream, ssize_t bodyOffset)
+{
+	Begin();
+
+	// if we have a message: seek to GetBodyOffset()
+	if (bodyOffset != -1)
+	{
+		stream.clear();
+		stream.seekg(bodyOffset, std::istream::beg);
+
+		while (stream.good() && !IsDone())
+		{
+			char buffer[8096];
+			stream.read(buffer, sizeof buffer);
+			Update(buffer, (size_t)stream.gcount());
+		}
+	}
+
+	Final();
+}
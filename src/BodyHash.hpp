@@ -0,0 +1,130 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_BODYHASH_HPP_
+#define _DKIM_BODYHASH_HPP_
+
+#include "DKIM.hpp"
+#include "Canonicalization.hpp"
+#include "Pipeline.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <istream>
+#include <sys/types.h>
+#include <openssl/evp.h>
+
+namespace DKIM {
+	namespace Conversion {
+		/*
+		 * Computes every body hash needed by the signatures of a message,
+		 * canonicalizing the body only once per canonicalization mode.
+		 * Body length limits (l=) are served from a snapshot of the digest
+		 * taken at the limit boundary.
+		 *
+		 * The body is either read by Run() or pushed in chunks of any size
+		 * with Update() followed by Final(); all hashes must be added before
+		 * the first chunk.
+		 *
+		 * If pipelined, the canonicalized body is hashed by one thread per
+		 * digest while the caller reads and canonicalizes ahead; meant for
+		 * large bodies only.
+		 *
+		 * Reset() keeps the digest contexts and the capacity of the tables,
+		 * a reused BodyHash hashes the body without allocating.
+		 */
+		class BodyHash
+		{
+			public:
+				BodyHash();
+				~BodyHash();
+
+				void Reset();
+
+				void Add(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize);
+				void SetDotStuffed(bool dotStuffed);
+				void SetLineEnding(LineEnding lineEnding);
+				void SetPipelined(bool pipelined);
+
+				void Update(const char* data, size_t size);
+				void Final();
+				void Run(std::istream& stream, ssize_t bodyOffset);
+				bool IsDone() const;
+
+				bool Get(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize, std::string& hash) const;
+			private:
+				BodyHash(const BodyHash&);
+
+				struct Entry
+				{
+					CanonMode type;
+					DigestAlgorithm algorithm;
+					bool bodyLimit;
+					size_t bodySize;
+
+					bool done;
+					unsigned char hash[EVP_MAX_MD_SIZE];
+					unsigned int hashSize;
+				};
+				typedef std::unique_ptr<EVP_MD_CTX, std::function<void(EVP_MD_CTX*)>> EVPContext;
+				struct Digest
+				{
+					EVPContext ctx;
+					EVPContext snapshot;
+					std::vector<size_t> limited;
+					std::vector<size_t> full;
+					size_t next;
+					size_t offset;
+				};
+				struct Pass
+				{
+					BodyHash* bodyHash;
+					std::optional<BodyCanonicalizer> canonicalbody;
+					Digest digests[2];
+					size_t digestCount;
+					std::unique_ptr<Pipeline> pipeline;
+
+					void operator()(const char* data, size_t size)
+					{ bodyHash->Feed(*this, data, size); }
+				};
+
+				std::vector<Entry>::iterator Find(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize);
+				std::vector<Entry>::const_iterator Find(CanonMode type, DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize) const;
+
+				void Begin();
+				void Feed(Pass& pass, const char* data, size_t size);
+				void FeedDigest(Digest& digest, const char* data, size_t size);
+				void Finalize(Digest& digest, Entry& entry);
+
+				std::vector<Entry> m_entries;
+				Pass m_passes[2];
+				size_t m_passCount;
+				bool m_started;
+				bool m_dotStuffed;
+				LineEnding m_lineEnding;
+				bool m_pipelined;
+		};
+	}
+}
+
+#endif
@@ -19,200 +19,698 @@
  *
  */
 #include "Canonicalization.hpp"
-#include "Tokenizer.hpp"
+#include "MailParser.hpp"
 #include "Util.hpp"
 #include "Exception.hpp"
 
-#include <sstream>
+#include <istream>
+#include <cstring>
+#include <cctype>
 #include <cstdio>
 #include <algorithm>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DKIM_SIMD_X86
+#include <immintrin.h>
+#endif
+
 using DKIM::Conversion::CanonicalizationHeader;
-using DKIM::Tokenizer::ReadWhiteSpace;
+using DKIM::Conversion::BodyCanonicalizer;
 using DKIM::Util::StringFormat;
 
+namespace {
+	/*
+	 * The body scanners return the offset of the first byte in data that
+	 * the body canonicalization has to act upon, or size if there is none.
+	 * All bytes before it are copied as one run. For simple that is CR and
+	 * LF; for relaxed also HTAB, and a SP unless it stands alone between
+	 * two ordinary bytes (a lone SP is already canonical, so that a run
+	 * covers a line of text and not just a word).
+	 */
+	typedef size_t (*BodyScanner)(const char* data, size_t size);
+
+	inline bool IsBodyWsp(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	template <bool relaxed>
+	size_t BodyScanScalar(const char* data, size_t size)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			char c = data[i];
+			if (c == '\r' || c == '\n')
+				return i;
+			if (relaxed && (c == '\t' || (c == ' ' && (i + 1 == size || IsBodyWsp(data[i + 1])))))
+				return i;
+		}
+		return size;
+	}
+
+#ifdef DKIM_SIMD_X86
+	template <bool relaxed>
+	__attribute__((target("sse2")))
+	size_t BodyScanSSE2(const char* data, size_t size)
+	{
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i sp = _mm_set1_epi8(' ');
+		const __m128i ht = _mm_set1_epi8('\t');
+		size_t i = 0;
+		// relaxed looks one byte ahead, the last block goes to the scalar tail
+		for (; i + 16 + relaxed <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+			__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+			if (relaxed)
+			{
+				__m128i n = _mm_loadu_si128((const __m128i*)(data + i + 1));
+				__m128i wsp = _mm_or_si128(
+						_mm_or_si128(_mm_cmpeq_epi8(n, cr), _mm_cmpeq_epi8(n, lf)),
+						_mm_or_si128(_mm_cmpeq_epi8(n, sp), _mm_cmpeq_epi8(n, ht)));
+				m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, ht),
+							_mm_and_si128(_mm_cmpeq_epi8(v, sp), wsp)));
+			}
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+			if (mask)
+				return i + (size_t)__builtin_ctz(mask);
+		}
+		return i + BodyScanScalar<relaxed>(data + i, size - i);
+	}
+
+	template <bool relaxed>
+	__attribute__((target("avx2")))
+	size_t BodyScanAVX2(const char* data, size_t size)
+	{
+		const __m256i cr = _mm256_set1_epi8('\r');
+		const __m256i lf = _mm256_set1_epi8('\n');
+		const __m256i sp = _mm256_set1_epi8(' ');
+		const __m256i ht = _mm256_set1_epi8('\t');
+		size_t i = 0;
+		for (; i + 32 + relaxed <= size; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+			__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf));
+			if (relaxed)
+			{
+				__m256i n = _mm256_loadu_si256((const __m256i*)(data + i + 1));
+				__m256i wsp = _mm256_or_si256(
+						_mm256_or_si256(_mm256_cmpeq_epi8(n, cr), _mm256_cmpeq_epi8(n, lf)),
+						_mm256_or_si256(_mm256_cmpeq_epi8(n, sp), _mm256_cmpeq_epi8(n, ht)));
+				m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, ht),
+							_mm256_and_si256(_mm256_cmpeq_epi8(v, sp), wsp)));
+			}
+			unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+			if (mask)
+				return i + (size_t)__builtin_ctz(mask);
+		}
+		return i + BodyScanScalar<relaxed>(data + i, size - i);
+	}
+
+	template <bool relaxed>
+	__attribute__((target("avx512f,avx512bw")))
+	size_t BodyScanAVX512(const char* data, size_t size)
+	{
+		const __m512i cr = _mm512_set1_epi8('\r');
+		const __m512i lf = _mm512_set1_epi8('\n');
+		const __m512i sp = _mm512_set1_epi8(' ');
+		const __m512i ht = _mm512_set1_epi8('\t');
+		size_t i = 0;
+		while (i < size)
+		{
+			// the last block is loaded with a mask, so there is no scalar tail
+			size_t left = size - i;
+			__mmask64 load = left >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << left) - 1);
+			__m512i v = _mm512_maskz_loadu_epi8(load, data + i);
+			__mmask64 m = _mm512_cmpeq_epi8_mask(v, cr) | _mm512_cmpeq_epi8_mask(v, lf);
+			if (relaxed)
+			{
+				// a SP without a following byte in the buffer counts as not alone
+				__mmask64 next = left - 1 >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (left - 1)) - 1);
+				__m512i n = _mm512_maskz_loadu_epi8(next, data + i + 1);
+				__mmask64 wsp = _mm512_cmpeq_epi8_mask(n, cr) | _mm512_cmpeq_epi8_mask(n, lf)
+					| _mm512_cmpeq_epi8_mask(n, sp) | _mm512_cmpeq_epi8_mask(n, ht) | ~next;
+				m |= _mm512_cmpeq_epi8_mask(v, ht) | (_mm512_cmpeq_epi8_mask(v, sp) & wsp);
+			}
+			m &= load;
+			if (m)
+				return i + (size_t)__builtin_ctzll(m);
+			i += 64;
+		}
+		return size;
+	}
+#endif
+
+	struct BodyScanners
+	{
+		BodyScanner simple;
+		BodyScanner relaxed;
+	};
+
+	/*
+	 * Pick the widest kernel supported by the CPU, once at load time
+	 */
+	BodyScanners SelectBodyScanners()
+	{
+		BodyScanners scanners = { BodyScanScalar<false>, BodyScanScalar<true> };
+#ifdef DKIM_SIMD_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512bw"))
+		{
+			scanners.simple = BodyScanAVX512<false>;
+			scanners.relaxed = BodyScanAVX512<true>;
+		}
+		else if (__builtin_cpu_supports("avx2"))
+		{
+			scanners.simple = BodyScanAVX2<false>;
+			scanners.relaxed = BodyScanAVX2<true>;
+		}
+		else if (__builtin_cpu_supports("sse2"))
+		{
+			scanners.simple = BodyScanSSE2<false>;
+			scanners.relaxed = BodyScanSSE2<true>;
+		}
+#endif
+		return scanners;
+	}
+
+	const BodyScanners bodyScanners = SelectBodyScanners();
+
+	/*
+	 * Output stage of the relaxed header canonicalization; it lowercases
+	 * the header field name and deletes the SPs before and after the
+	 * colon as the unfolded bytes pass through, and collects the result
+	 * in a fixed buffer so that the sink sees few and large writes.
+	 */
+	class RelaxedHeaderWriter
+	{
+		public:
+			RelaxedHeaderWriter(DKIM::Conversion::DataSink& func)
+			: m_func(func)
+			, m_size(0)
+			, m_state(NAME)
+			, m_name(false)
+			, m_pendingwsp(0)
+			{ }
+
+			void Put(char c)
+			{
+				switch (m_state)
+				{
+					case NAME:
+						if (c == ' ')
+						{
+							++m_pendingwsp;
+							return;
+						}
+						if (c == ':')
+						{
+							// keep the SPs if the name is made of nothing else
+							if (!m_name)
+								PutSpaces();
+							m_pendingwsp = 0;
+							m_state = COLON;
+							Append(c);
+							return;
+						}
+						PutSpaces();
+						m_name = true;
+						Append((char)tolower((unsigned char)c));
+						return;
+					case COLON:
+						if (c == ' ')
+							return;
+						m_state = VALUE;
+						break;
+					case VALUE:
+						break;
+				}
+				Append(c);
+			}
+
+			void Put(const char* data, size_t size)
+			{
+				while (size > 0 && m_state != VALUE)
+				{
+					Put(*data++);
+					--size;
+				}
+				if (size == 0)
+					return;
+				if (size > sizeof(m_buffer) - m_size)
+				{
+					Flush();
+					if (size > sizeof(m_buffer))
+					{
+						m_func(data, size);
+						return;
+					}
+				}
+				memcpy(m_buffer + m_size, data, size);
+				m_size += size;
+			}
+
+			void Flush()
+			{
+				if (m_size)
+					m_func(m_buffer, m_size);
+				m_size = 0;
+			}
+		private:
+			void Append(char c)
+			{
+				if (m_size == sizeof(m_buffer))
+					Flush();
+				m_buffer[m_size++] = c;
+			}
+
+			void PutSpaces()
+			{
+				for (; m_pendingwsp > 0; --m_pendingwsp)
+					Append(' ');
+			}
+
+			DKIM::Conversion::DataSink& m_func;
+			char m_buffer[512];
+			size_t m_size;
+			enum { NAME, COLON, VALUE } m_state;
+			bool m_name;
+			size_t m_pendingwsp;
+	};
+
+	inline bool IsHeaderWsp(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	template <DKIM::CanonMode type>
+	void WriteHeaderMode(const char* input, size_t size, DKIM::Conversion::DataSink func, bool crlf);
+
+	template <>
+	void WriteHeaderMode<DKIM::DKIM_C_SIMPLE>(const char* input, size_t size, DKIM::Conversion::DataSink func, bool crlf)
+	{
+		func(input, size);
+		if (crlf)
+			func("\r\n", 2);
+	}
+
+	template <>
+	void WriteHeaderMode<DKIM::DKIM_C_RELAXED>(const char* input, size_t size, DKIM::Conversion::DataSink func, bool crlf)
+	{
+		const char* colon = (const char*)memchr(input, ':', size);
+		if (!colon)
+			throw DKIM::PermanentError(StringFormat("Header field %s is missing the colon separator",
+						std::string(input, size).c_str()
+						)
+					);
+
+		/**
+		 * The "relaxed" header canonicalization algorithm MUST apply the
+		 * following steps in order:
+		 *
+		 * Convert all header field names (not the header field values) to
+		 * lowercase.  For example, convert "SUBJect: AbC" to "subject: AbC".
+		 *
+		 * Unfold all header field continuation lines as described in
+		 * [RFC2822]; in particular, lines with terminators embedded in
+		 * continued header field values (that is, CRLF sequences followed by
+		 * WSP) MUST be interpreted without the CRLF.  Implementations MUST
+		 * NOT remove the CRLF at the end of the header field value.
+		 *
+		 * Convert all sequences of one or more WSP characters to a single SP
+		 * character.  WSP characters here include those before and after a
+		 * line folding boundary.
+		 *
+		 * Delete all WSP characters at the end of each unfolded header field
+		 * value.
+		 *
+		 * Delete any WSP characters remaining before and after the colon
+		 * separating the header field name from the header field value.  The
+		 * colon separator MUST be retained.
+		 *
+		 * The unfolding is done here (a FWS is WSP, optionally followed by
+		 * CRLF and at least one more WSP), the name and colon rules by the
+		 * writer.
+		 */
+
+		RelaxedHeaderWriter output(func);
+		bool found = false;
+		size_t i = 0;
+		while (i < size)
+		{
+			size_t j = i;
+			while (j < size && IsHeaderWsp(input[j]))
+				++j;
+
+			if (j < size && input[j] == '\r')
+			{
+				if (j + 1 == size)
+					throw DKIM::PermanentError("CR without matching LF, at the END");
+				if (input[j + 1] != '\n')
+					throw DKIM::PermanentError(StringFormat("CR without matching LF, 0x%x at position %ld",
+								(input + j + 1 < colon ? tolower((unsigned char)input[j + 1]) : input[j + 1]) & 0xff,
+								(ssize_t)(j + 1)
+								)
+							);
+				if (j + 2 < size && IsHeaderWsp(input[j + 2]))
+				{
+					for (j += 3; j < size && IsHeaderWsp(input[j]); ++j);
+					found = true;
+					i = j;
+					continue;
+				}
+
+				// a line break that is not folding is kept with the WSP before it
+				if (found)
+					output.Put(' ');
+				found = false;
+				output.Put(input + i, j + 2 - i);
+				i = j + 2;
+				continue;
+			}
+
+			if (j > i)
+			{
+				found = true;
+				i = j;
+				continue;
+			}
+
+			if (found)
+				output.Put(' ');
+			found = false;
+			while (j < size && !IsHeaderWsp(input[j]) && input[j] != '\r')
+				++j;
+			output.Put(input + i, j - i);
+			i = j;
+		}
+		if (crlf)
+			output.Put("\r\n", 2);
+		output.Flush();
+	}
+
+	typedef void (*HeaderWriter)(const char* input, size_t size, DKIM::Conversion::DataSink func, bool crlf);
+
+	HeaderWriter SelectHeaderWriter(DKIM::CanonMode type)
+	{
+		static const HeaderWriter writers[2] = {
+			WriteHeaderMode<DKIM::DKIM_C_SIMPLE>,
+			WriteHeaderMode<DKIM::DKIM_C_RELAXED>,
+		};
+		return writers[type == DKIM::DKIM_C_RELAXED];
+	}
+}
+
 CanonicalizationHeader::CanonicalizationHeader(CanonMode type)
 : m_type(type)
+, m_write(SelectHeaderWriter(type))
 {
 }
 
 void CanonicalizationHeader::SetType(CanonMode type)
 {
 	m_type = type;
+	m_write = SelectHeaderWriter(type);
 }
 
-std::string CanonicalizationHeader::FilterHeader(const std::string& input) const
+std::string CanonicalizationHeader::FilterHeader(std::string_view input) const
 {
-	if (m_type == DKIM_C_SIMPLE)
-		return input;
-	std::string output = input;
+	std::string output;
+	output.reserve(input.size());
+	WriteHeader(input, [&output] (const char* data, size_t size) {
+			output.append(data, size);
+		});
+	return output;
+}
 
-	/**
-	 * The "relaxed" header canonicalization algorithm MUST apply the
-	 * following steps in order:
-	 */
+void CanonicalizationHeader::WriteHeader(std::string_view input, DataSink func, bool crlf) const
+{
+	m_write(input.data(), input.size(), func, crlf);
+}
 
-	/**
-	 * Convert all header field names (not the header field values) to
-	 * lowercase.  For example, convert "SUBJect: AbC" to "subject: AbC".
-	 */
+void CanonicalizationHeader::WriteHeader(const Header& header, DataSink func, bool crlf) const
+{
+	const std::pmr::string& canonical = header.GetCanonical(m_type);
+	func(canonical.c_str(), canonical.size() - (crlf ? 0 : 2));
+}
 
-	std::string::iterator colon = std::find(output.begin(), output.end(), ':');
-	if (colon == output.end())
-		throw DKIM::PermanentError(StringFormat("Header field %s is missing the colon separator",
-					input.c_str()
-					)
-				);
-	transform(output.begin(), colon, output.begin(), tolower);
-
-	/**
-	 * Unfold all header field continuation lines as described in
-	 * [RFC2822]; in particular, lines with terminators embedded in
-	 * continued header field values (that is, CRLF sequences followed by
-	 * WSP) MUST be interpreted without the CRLF.  Implementations MUST
-	 * NOT remove the CRLF at the end of the header field value.
-	 *
-	 * Convert all sequences of one or more WSP characters to a single SP
-	 * character.  WSP characters here include those before and after a
-	 * line folding boundary.
-	 *
-	 * Delete all WSP characters at the end of each unfolded header field
-	 * value.
+BodyCanonicalizer::BodyCanonicalizer(CanonMode type, bool bodyLimit, size_t bodySize, DataSink func, bool dotStuffed,
+		LineEnding lineEnding)
+: m_type(type)
+, m_bodyLimit(bodyLimit)
+, m_bodySize(bodySize)
+, m_func(func)
+, m_pendingwsp(false)
+, m_lines(0)
+, m_emptyBody(true)
+, m_dot(DOT_LINE)
+, m_terminated(false)
+, m_crData(lineEnding == DKIM::DKIM_LE_LF)
+{
+	/*
+	 * Each canonicalization, body length limit and dot-stuffing combination
+	 * has its own instance of the loop, so that none of them is tested per
+	 * byte
 	 */
+	static void (BodyCanonicalizer::* const update[2][2][2])(const char*, size_t) = {
+		{
+			{ &BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_SIMPLE, false, false>,
+				&BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_SIMPLE, false, true> },
+			{ &BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_SIMPLE, true, false>,
+				&BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_SIMPLE, true, true> },
+		},
+		{
+			{ &BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_RELAXED, false, false>,
+				&BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_RELAXED, false, true> },
+			{ &BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_RELAXED, true, false>,
+				&BodyCanonicalizer::UpdateMode<DKIM::DKIM_C_RELAXED, true, true> },
+		},
+	};
+	m_update = update[type == DKIM::DKIM_C_RELAXED][bodyLimit][dotStuffed];
+}
 
-	std::stringstream data(output);
-
-	std::string x;
-	while (true)
+template <bool limited>
+void BodyCanonicalizer::Emit(const char* data, size_t size)
+{
+	if (size == 0) return;
+	if (limited)
 	{
-		bool found = false;
-		while (!ReadWhiteSpace(data, DKIM::Tokenizer::READ_FWS).empty())
-			found = true;
-
-		if (data.peek() == EOF) break;
-
-		if (found)
-			x += " ";
-
-		x += (char)data.get();
+		size_t left = std::min(size, m_bodySize);
+		m_func(data, left);
+		m_bodySize -= left;
+	} else {
+		m_func(data, size);
 	}
+}
 
-	/**
-	 * Delete any WSP characters remaining before and after the colon
-	 * separating the header field name from the header field value.  The
-	 * colon separator MUST be retained.
+template <bool limited>
+void BodyCanonicalizer::EmitDeferred()
+{
+	/*
+	   Ignores all empty lines at the end of the message body.  "Empty
+	   line" is defined in Section 3.4.3.
 	 */
+	static const char crlf[] = "\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n\r\n";
+	while (m_lines > 0)
+	{
+		size_t lines = std::min(m_lines, (sizeof crlf - 1) / 2);
+		Emit<limited>(crlf, lines * 2);
+		m_lines -= lines;
+	}
 
-	size_t colonSplit = x.find(':');
-	if (colonSplit == std::string::npos)
-		throw DKIM::PermanentError(StringFormat("Header field %s is missing the colon separator",
-					input.c_str()
-					)
-				);
-	size_t colonAfter = x.find_first_not_of(' ', colonSplit + 1);
-	if (colonAfter != std::string::npos)
-		x.erase(colonSplit + 1, (colonAfter - 1) - (colonSplit));
-	size_t colonBefore = x.substr(0, colonSplit).find_last_not_of(' ');
-	if (colonBefore != std::string::npos && colonBefore + 1 != colonSplit)
+	/*
+	   Ignores all whitespace at the end of lines.  Implementations MUST
+	   NOT remove the CRLF at the end of the line.
+	 */
+	if (m_pendingwsp)
 	{
-		x.erase(colonBefore + 1, colonSplit - (colonBefore + 1));
+		Emit<limited>(" ", 1);
+		m_pendingwsp = false;
 	}
+}
 
-	return x;
+void BodyCanonicalizer::Update(const char* data, size_t size)
+{
+	(this->*m_update)(data, size);
 }
 
-bool DKIM::Conversion::CanonicalizationBody(std::istream& stream, DKIM::CanonMode type, ssize_t bodyOffset, bool bodyLimit, size_t bodySize, std::function<void(const char *, size_t)> func)
+template <DKIM::CanonMode type, bool limited, bool dotStuffed>
+void BodyCanonicalizer::UpdateMode(const char* data, size_t size)
 {
-	bool emptyBody = true;
+	const bool relaxed = type == DKIM::DKIM_C_RELAXED;
+	const BodyScanner scan = relaxed ? bodyScanners.relaxed : bodyScanners.simple;
 
-	// if we have a message: seek to GetBodyOffset()
-	if (bodyOffset != -1)
-	{
-		stream.clear();
-		stream.seekg(bodyOffset, std::istream::beg);
+	if (IsDone()) return;
 
-		bool pendingwsp = false;
-		size_t lines = 0;
-		while (stream.good())
-		{
-			if (bodyLimit && bodySize == 0) break;
+	/*
+	 * [span, spanEnd) is input that is identical to its canonical form,
+	 * it is emitted as is. The deferred empty lines and whitespace are
+	 * absorbed into the span if the input following it is exactly their
+	 * canonical form ("\r\n" per line and a single SP), otherwise the span
+	 * is flushed and they are synthesized.
+	 *
+	 * The state is kept in locals while in the loop (there is never any
+	 * pending whitespace in simple) and stored back when leaving it.
+	 */
+	size_t lines = m_lines;
+	bool pendingwsp = relaxed && m_pendingwsp;
+	bool emptyBody = m_emptyBody;
+	DotState dot = dotStuffed ? m_dot : DOT_NONE;
 
-			char buffer[8096];
-			stream.read(buffer, sizeof buffer);
+	const char* span = data;
+	const char* spanEnd = data;
+	bool verbatim = lines == 0 && !pendingwsp;
 
-			std::string buf;
-			for (size_t i = 0; i < stream.gcount(); ++i)
+	const char* ptr = data;
+	const char* end = data + size;
+	while (ptr < end)
+	{
+		/*
+		 * SMTP transparency (RFC 5321, 4.5.2); the first period of a line
+		 * is removed, unless the line is only a period which terminates
+		 * the data.
+		 */
+		if (dotStuffed && dot != DOT_NONE)
+		{
+			char c = *ptr;
+			if (dot == DOT_LINE)
 			{
-				if (buffer[i] == '\r')
-					continue;
-				if (buffer[i] == '\n')
-				{
-					pendingwsp = false;
-					++lines;
-					continue;
-				}
-
-				/*
-				   Reduces all sequences of WSP within a line to a single SP
-				   character.
-				 */
-				if (type == DKIM::DKIM_C_RELAXED && (buffer[i] == ' ' || buffer[i] == '\t'))
+				dot = DOT_NONE;
+				if (c == '.')
 				{
-					pendingwsp = true;
+					verbatim = false;
+					dot = DOT_DOT;
+					++ptr;
 					continue;
 				}
+			} else if (c == '\n') {
+				m_terminated = true;
+				break;
+			} else if (dot == DOT_DOT && c == '\r' && !m_crData) {
+				// with LF line endings the CR is data, and copied below
+				dot = DOT_DOTCR;
+				++ptr;
+				continue;
+			} else {
+				// the line continues, a CR after the period is dropped as any lone CR
+				dot = DOT_NONE;
+			}
+		}
 
-				/*
-				   Ignores all empty lines at the end of the message body.  "Empty
-				   line" is defined in Section 3.4.3.
-				 */
-				while (lines > 0)
-				{
-					buf += "\r\n";
-					--lines;
-				}
-
-				/*
-				   Ignores all whitespace at the end of lines.  Implementations MUST
-				   NOT remove the CRLF at the end of the line.
-				 */
-				if (pendingwsp)
-				{
-					buf += ' ';
-					pendingwsp = false;
-				}
-
-				buf += buffer[i];
+		size_t run = scan(ptr, (size_t)(end - ptr));
+		// with LF line endings a CR is copied as any other byte (it is rare)
+		if (run == 0 && *ptr == '\r' && m_crData)
+			run = 1;
+		if (run > 0)
+		{
+			// a lone SP that starts the run joins the whitespace before it
+			if (relaxed && pendingwsp && *ptr == ' ')
+			{
+				verbatim = false;
+				++ptr;
+				--run;
 			}
+			if (!verbatim)
+			{
+				Emit<limited>(span, (size_t)(spanEnd - span));
+				m_lines = lines;
+				m_pendingwsp = pendingwsp;
+				EmitDeferred<limited>();
+				span = ptr;
+			}
+			lines = 0;
+			pendingwsp = false;
+			emptyBody = false;
 
-			if (bodyLimit)
+			ptr += run;
+			spanEnd = ptr;
+			verbatim = true;
+			continue;
+		}
+
+		char c = *ptr;
+		if (c == '\r')
+		{
+			if (ptr + 1 < end && ptr[1] == '\n')
 			{
-				size_t left = std::min(buf.size(), bodySize);
-				func(buf.c_str(), left);
-				bodySize -= left;
-			} else {
-				func(buf.c_str(), buf.size());
+				// whitespace before the CRLF is dropped
+				verbatim = verbatim && !pendingwsp;
+				pendingwsp = false;
+				++lines;
+				ptr += 2;
+				if (dotStuffed)
+					dot = DOT_LINE;
+				continue;
 			}
+			verbatim = false;
+			++ptr;
+			continue;
+		}
+		if (c == '\n')
+		{
+			verbatim = false;
+			pendingwsp = false;
+			++lines;
+			++ptr;
+			if (dotStuffed)
+				dot = DOT_LINE;
+			continue;
+		}
 
-			if (!buf.empty())
-				emptyBody = false;
+		/*
+		   Reduces all sequences of WSP within a line to a single SP
+		   character.
+		 */
+		if (relaxed)
+		{
+			if (pendingwsp || c != ' ')
+				verbatim = false;
+			pendingwsp = true;
 		}
+		++ptr;
 	}
 
+	Emit<limited>(span, (size_t)(spanEnd - span));
+	m_lines = lines;
+	m_pendingwsp = pendingwsp;
+	m_emptyBody = emptyBody;
+	if (dotStuffed)
+		m_dot = dot;
+}
+
+bool BodyCanonicalizer::Final()
+{
 	// the rfc is unclear about this, but google does not insert an empty \r\n for
 	// relaxed canonicalization...
-	if (emptyBody == false || type != DKIM::DKIM_C_RELAXED)
+	if (m_emptyBody == false || m_type != DKIM::DKIM_C_RELAXED)
+	{
+		if (m_bodyLimit)
+			Emit<true>("\r\n", 2);
+		else
+			Emit<false>("\r\n", 2);
+	}
+
+	return !(m_bodyLimit && m_bodySize > 0);
+}
+
+bool DKIM::Conversion::CanonicalizationBody(std::istream& stream, DKIM::CanonMode type, ssize_t bodyOffset, bool bodyLimit, size_t bodySize, DataSink func)
+{
+	BodyCanonicalizer canonicalbody(type, bodyLimit, bodySize, func);
+
+	// if we have a message: seek to GetBodyOffset()
+	if (bodyOffset != -1)
 	{
-		std::string buf = "\r\n";
-		if (bodyLimit)
+		stream.clear();
+		stream.seekg(bodyOffset, std::istream::beg);
+
+		while (stream.good() && !canonicalbody.IsDone())
 		{
-			size_t left = std::min(buf.size(), bodySize);
-			func(buf.c_str(), left);
-			bodySize -= left;
-		} else {
-			func(buf.c_str(), buf.size());
+			char buffer[8096];
+			stream.read(buffer, sizeof buffer);
+			canonicalbody.Update(buffer, (size_t)stream.gcount());
 		}
 	}
 
-	return !(bodyLimit && bodySize > 0);
+	return canonicalbody.Final();
 }
@@ -24,12 +24,38 @@
 #include "DKIM.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
+#include <type_traits>
 #include <openssl/evp.h>
 
 namespace DKIM {
+	class Header;
+
 	namespace Conversion {
+		/*
+		 * Non-owning reference to a callable taking (const char*, size_t),
+		 * the callable must outlive the reference.
+		 */
+		class DataSink
+		{
+			public:
+				template <typename F, typename = typename std::enable_if<
+					!std::is_same<typename std::decay<F>::type, DataSink>::value>::type>
+				DataSink(F&& func)
+				: m_obj((void*)&func)
+				, m_call([] (void* obj, const char* data, size_t size) {
+						(*static_cast<typename std::remove_reference<F>::type*>(obj))(data, size);
+					})
+				{ }
+
+				void operator()(const char* data, size_t size) const
+				{ m_call(m_obj, data, size); }
+			private:
+				void* m_obj;
+				void (*m_call)(void*, const char*, size_t);
+		};
 		struct EVPDigest
 		{
 			EVP_MD_CTX* ctx;
@@ -37,18 +63,88 @@ namespace DKIM {
 			{
 				EVP_DigestUpdate(ctx, ptr, i);
 			}
+			void operator()(const char* ptr, size_t i)
+			{
+				EVP_DigestUpdate(ctx, ptr, i);
+			}
 		};
+		/*
+		 * Header canonicalization; WriteHeader() passes the canonical form
+		 * of a header field to the sink in one pass and without allocating,
+		 * followed by the CRLF that ends it if crlf is set. Given a Header,
+		 * its cached canonical form is used.
+		 */
 		class CanonicalizationHeader
 		{
 			public:
 				CanonicalizationHeader(CanonMode type);
 				void SetType(CanonMode type);
 
-				std::string FilterHeader(const std::string& input) const;
+				std::string FilterHeader(std::string_view input) const;
+				void WriteHeader(std::string_view input, DataSink func, bool crlf = false) const;
+				void WriteHeader(const Header& header, DataSink func, bool crlf = false) const;
 			private:
 				CanonMode m_type;
+				void (*m_write)(const char* input, size_t size, DataSink func, bool crlf);
+		};
+		/*
+		 * Push-based body canonicalization; the body may be passed to
+		 * Update() in chunks of any size (eg. as received from the SMTP
+		 * client), the state between them is kept. Final() is to be
+		 * called at the end of the body, it returns false if the body
+		 * was shorter than the body length limit.
+		 *
+		 * Runs of input that are already in canonical form are passed to
+		 * the sink directly from the caller's buffer, only replaced bytes
+		 * (a single SP, deferred CRLFs) are synthesized.
+		 *
+		 * If dotStuffed, the body is SMTP DATA that is still dot-stuffed;
+		 * it is unstuffed in the same pass, and ends at the "." line.
+		 *
+		 * With the DKIM_LE_CRLF line ending CRLF and LF end a line, and
+		 * other CRs are dropped; with DKIM_LE_LF only LF ends a line and
+		 * CR is data.
+		 */
+		class BodyCanonicalizer
+		{
+			public:
+				BodyCanonicalizer(CanonMode type, bool bodyLimit, size_t bodySize, DataSink func, bool dotStuffed = false,
+						LineEnding lineEnding = DKIM_LE_CRLF);
+
+				void Update(const char* data, size_t size);
+				bool Final();
+
+				bool IsDone() const
+				{ return m_terminated || (m_bodyLimit && m_bodySize == 0); }
+			private:
+				typedef enum {
+					DOT_NONE,	// within a line
+					DOT_LINE,	// at the start of a line
+					DOT_DOT,	// after a leading period
+					DOT_DOTCR,	// after a leading period and CR
+				} DotState;
+
+				template <CanonMode type, bool limited, bool dotStuffed>
+				void UpdateMode(const char* data, size_t size);
+				template <bool limited>
+				void Emit(const char* data, size_t size);
+				template <bool limited>
+				void EmitDeferred();
+
+				CanonMode m_type;
+				bool m_bodyLimit;
+				size_t m_bodySize;
+				DataSink m_func;
+				void (BodyCanonicalizer::*m_update)(const char* data, size_t size);
+
+				bool m_pendingwsp;
+				size_t m_lines;
+				bool m_emptyBody;
+				DotState m_dot;
+				bool m_terminated;
+				bool m_crData;
 		};
-		bool CanonicalizationBody(std::istream& stream, CanonMode type, ssize_t bodyOffset, bool bodyLimit, size_t bodySize, std::function<void(const char *, size_t)> func);
+		bool CanonicalizationBody(std::istream& stream, CanonMode type, ssize_t bodyOffset, bool bodyLimit, size_t bodySize, DataSink func);
 	}
 }
 
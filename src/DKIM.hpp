@@ -35,6 +35,11 @@ namespace DKIM
 		DKIM_C_SIMPLE,
 		DKIM_C_RELAXED,
 	} CanonMode;
+	typedef enum {
+		DKIM_LE_CRLF,
+		DKIM_LE_LF,
+		DKIM_LE_AUTO,
+	} LineEnding;
 }
 
 #endif
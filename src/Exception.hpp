@@ -57,6 +57,15 @@ namespace DKIM
 		private:
 			AR_CLASS ar_class;
 	};
+	/*
+	 * A resource limit (see Limits) was exceeded by the message
+	 */
+	class LimitError : public PermanentError {
+		public:
+			LimitError(std::string const& msg):
+				PermanentError(msg)
+			{}
+	};
 	class TemporaryError : public std::runtime_error {
 		public:
 			TemporaryError(std::string const& msg, AR_CLASS ar_class_ = AR_CLASS::AR_TEMPERROR):
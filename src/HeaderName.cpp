@@ -0,0 +1,98 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "HeaderName.hpp"
+#include "PerfectHash.hpp"
+
+using DKIM::HeaderName::Id;
+
+namespace {
+	// the names in lowercase, in the order of Id
+	constexpr std::string_view names[] = {
+		"",
+		"from",
+		"sender",
+		"reply-to",
+		"to",
+		"cc",
+		"bcc",
+		"subject",
+		"date",
+		"message-id",
+		"in-reply-to",
+		"references",
+		"comments",
+		"keywords",
+		"resent-date",
+		"resent-from",
+		"resent-sender",
+		"resent-to",
+		"resent-cc",
+		"resent-bcc",
+		"resent-message-id",
+		"return-path",
+		"received",
+		"mime-version",
+		"content-type",
+		"content-transfer-encoding",
+		"content-id",
+		"content-description",
+		"content-disposition",
+		"dkim-signature",
+		"arc-seal",
+		"arc-message-signature",
+		"arc-authentication-results",
+		"authentication-results",
+		"list-id",
+		"list-help",
+		"list-unsubscribe",
+		"list-unsubscribe-post",
+		"list-subscribe",
+		"list-post",
+		"list-owner",
+		"list-archive",
+		"cfbl-address",
+		"cfbl-feedback-id",
+	};
+	static_assert(sizeof names / sizeof *names == DKIM::HeaderName::COUNT, "a name for each Id");
+
+	constexpr DKIM::PerfectHash<DKIM::HeaderName::COUNT, 256, true> hash(names);
+}
+
+/*
+ * Lookup()
+ *
+ * The Id of a header field name (in any case), by a perfect hash that is
+ * computed at compile time; UNKNOWN if it is not a well-known name
+ */
+Id DKIM::HeaderName::Lookup(std::string_view name)
+{
+	return (Id)hash.Lookup(name);
+}
+
+/*
+ * Name()
+ *
+ * The name of an Id in lowercase, empty for UNKNOWN
+ */
+std::string_view DKIM::HeaderName::Name(Id id)
+{
+	return hash.Name(id);
+}
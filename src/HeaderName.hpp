@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_HEADERNAME_HPP_
+#define _DKIM_HEADERNAME_HPP_
+
+#include <string_view>
+
+namespace DKIM {
+	namespace HeaderName {
+		/*
+		 * Well-known header field names (RFC 5322, RFC 6376, RFC 8617
+		 * and the list headers), interned as a number while parsing so
+		 * that they are compared as integers; other names are UNKNOWN
+		 * and compared as strings
+		 */
+		typedef enum {
+			UNKNOWN,
+			FROM,
+			SENDER,
+			REPLY_TO,
+			TO,
+			CC,
+			BCC,
+			SUBJECT,
+			DATE,
+			MESSAGE_ID,
+			IN_REPLY_TO,
+			REFERENCES,
+			COMMENTS,
+			KEYWORDS,
+			RESENT_DATE,
+			RESENT_FROM,
+			RESENT_SENDER,
+			RESENT_TO,
+			RESENT_CC,
+			RESENT_BCC,
+			RESENT_MESSAGE_ID,
+			RETURN_PATH,
+			RECEIVED,
+			MIME_VERSION,
+			CONTENT_TYPE,
+			CONTENT_TRANSFER_ENCODING,
+			CONTENT_ID,
+			CONTENT_DESCRIPTION,
+			CONTENT_DISPOSITION,
+			DKIM_SIGNATURE,
+			ARC_SEAL,
+			ARC_MESSAGE_SIGNATURE,
+			ARC_AUTHENTICATION_RESULTS,
+			AUTHENTICATION_RESULTS,
+			LIST_ID,
+			LIST_HELP,
+			LIST_UNSUBSCRIBE,
+			LIST_UNSUBSCRIBE_POST,
+			LIST_SUBSCRIBE,
+			LIST_POST,
+			LIST_OWNER,
+			LIST_ARCHIVE,
+			CFBL_ADDRESS,
+			CFBL_FEEDBACK_ID,
+			COUNT
+		} Id;
+
+		Id Lookup(std::string_view name);
+		std::string_view Name(Id id);
+	}
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_LIMITS_HPP_
+#define _DKIM_LIMITS_HPP_
+
+#include <cstddef>
+
+namespace DKIM
+{
+	/*
+	 * Resource limits for untrusted messages, so that the cost of one
+	 * message is bounded; 0 is no limit. The header limits are enforced
+	 * while the header is parsed, the others while the signatures and
+	 * keys are; exceeding one is a LimitError. Signatures beyond the
+	 * maximum are not evaluated (RFC 6376, 6.1).
+	 *
+	 * A default constructed Limits has the Default values below, and they
+	 * apply to every source unless changed, also to those that Validatory
+	 * and Signatory create for a message. A header of more than 1 MiB or
+	 * 2000 fields is thus rejected where it was accepted before; pass
+	 * other Limits (eg. SetMaxHeaderCount(0)) to their constructors or
+	 * Reset() to lift them.
+	 */
+	class Limits
+	{
+		public:
+			static const size_t DefaultMaxHeaderBytes = 1024 * 1024;
+			static const size_t DefaultMaxHeaderCount = 2000;
+			static const size_t DefaultMaxSignatures = 32;
+			static const size_t DefaultMaxSignedHeaders = 256;
+			static const size_t DefaultMaxRecordSize = 8 * 1024;
+
+			Limits()
+			: m_maxHeaderBytes(DefaultMaxHeaderBytes)
+			, m_maxHeaderCount(DefaultMaxHeaderCount)
+			, m_maxSignatures(DefaultMaxSignatures)
+			, m_maxSignedHeaders(DefaultMaxSignedHeaders)
+			, m_maxRecordSize(DefaultMaxRecordSize)
+			{ }
+
+			Limits& SetMaxHeaderBytes(size_t bytes)
+			{ m_maxHeaderBytes = bytes; return *this; }
+			Limits& SetMaxHeaderCount(size_t count)
+			{ m_maxHeaderCount = count; return *this; }
+			Limits& SetMaxSignatures(size_t count)
+			{ m_maxSignatures = count; return *this; }
+			Limits& SetMaxSignedHeaders(size_t count)
+			{ m_maxSignedHeaders = count; return *this; }
+			Limits& SetMaxRecordSize(size_t bytes)
+			{ m_maxRecordSize = bytes; return *this; }
+
+			size_t GetMaxHeaderBytes() const
+			{ return m_maxHeaderBytes; }
+			size_t GetMaxHeaderCount() const
+			{ return m_maxHeaderCount; }
+			size_t GetMaxSignatures() const
+			{ return m_maxSignatures; }
+			size_t GetMaxSignedHeaders() const
+			{ return m_maxSignedHeaders; }
+			size_t GetMaxRecordSize() const
+			{ return m_maxRecordSize; }
+		private:
+			size_t m_maxHeaderBytes;
+			size_t m_maxHeaderCount;
+			size_t m_maxSignatures;
+			size_t m_maxSignedHeaders;
+			size_t m_maxRecordSize;
+	};
+}
+
+#endif
@@ -19,52 +19,102 @@
  *
  */
 #include "MailParser.hpp"
+#include "Canonicalization.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <iterator>
 
 using DKIM::Header;
 using DKIM::Message;
+using DKIM::Util::StringFormat;
 
-Header::Header()
-: m_valueOffset(0)
-{
+namespace {
+	bool EqualsNoCase(std::string_view a, std::string_view b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); ++i)
+			if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+				return false;
+		return true;
+	}
 }
 
-Header::~Header()
+Header::Header(std::pmr::memory_resource* resource)
+: m_data(nullptr)
+, m_owned(false)
+, m_offset(0)
+, m_length(0)
+, m_nameOffset(0)
+, m_nameLength(0)
+, m_valueOffset(0)
+, m_nameId(DKIM::HeaderName::UNKNOWN)
+, m_canonical { std::pmr::string(resource), std::pmr::string(resource) }
+, m_canonicalized()
 {
 }
 
-bool Header::ParseLine(const std::string& data)
+/*
+ * IsName()
+ *
+ * If the header field has the name given in lowercase, in any case
+ */
+bool Header::IsName(std::string_view name) const
 {
-	if (!m_header.empty())
-		m_header += "\r\n";
-
-	m_header += data;
-
-	if (m_valueOffset == 0)
-	{
-		size_t sep = m_header.find(':');
-		if (sep == std::string::npos)
+	std::string_view own = GetName();
+	if (own.size() != name.size())
+		return false;
+	for (size_t i = 0; i < name.size(); ++i)
+		if ((char)tolower((unsigned char)own[i]) != name[i])
 			return false;
-
-		m_valueOffset = sep + 1;
-
-		m_name = m_header.substr(0, sep);
-		m_name.erase(0, m_name.find_first_not_of(" \t"));
-		m_name.erase(m_name.find_last_not_of(" \t") + 1);
-	}
 	return true;
 }
 
-const std::string& Header::GetName() const
+/*
+ * HashName()
+ *
+ * Case-insensitive hash of a header field name (FNV-1a)
+ */
+size_t Header::HashName(std::string_view name)
 {
-	return m_name;
+	size_t hash = 2166136261u;
+	for (auto c : name)
+	{
+		hash ^= (unsigned char)tolower((unsigned char)c);
+		hash *= 16777619u;
+	}
+	return hash;
 }
 
-const std::string& Header::GetHeader() const
+const std::pmr::string& Header::GetCanonical(CanonMode type) const
 {
-	return m_header;
+	size_t mode = type == DKIM::DKIM_C_RELAXED;
+	std::pmr::string& canonical = m_canonical[mode];
+	if (!m_canonicalized[mode])
+	{
+		canonical.clear();
+		DKIM::Conversion::CanonicalizationHeader(type).WriteHeader(GetHeader(), [&canonical] (const char* data, size_t size) {
+				canonical.append(data, size);
+			}, true);
+		m_canonicalized[mode] = true;
+	}
+	return canonical;
 }
 
-Message::Message()
+Message::Message(std::pmr::memory_resource* resource)
+: m_resource(resource)
+, m_line(resource)
+, m_dotStuffed(false)
+, m_lineEnding(DKIM::DKIM_LE_CRLF)
+, m_storage(resource)
+, m_fields(resource)
+, m_header(resource)
+, m_index(resource)
+, m_indexSlots(resource)
 {
 	Reset();
 }
@@ -72,9 +122,62 @@ Message::Message()
 void Message::Reset()
 {
 	m_done = false;
-	m_tmpHeader.reset();
+	m_buffer = nullptr;
+	m_storage.clear();
+	m_fields.clear();
 	m_header.clear();
+	m_index.clear();
+	m_indexSlots.clear();
+	std::fill(std::begin(m_knownIndex), std::end(m_knownIndex), 0);
 	m_bodyOffset = 0;
+	m_line.clear();
+	m_offset = 0;
+	m_headerBytes = 0;
+}
+
+/*
+ * SetDotStuffed()
+ *
+ * The message is SMTP DATA that is still dot-stuffed (RFC 5321, 4.5.2),
+ * the leading period of each header line is removed and the header ends
+ * at the terminating "." line.
+ */
+void Message::SetDotStuffed(bool dotStuffed)
+{
+	m_dotStuffed = dotStuffed;
+}
+
+/*
+ * SetLineEnding()
+ *
+ * With CRLF (the default) lines end with CRLF or LF, and a CR at the end
+ * of a line is removed. With LF lines end with LF, and CR is data. AUTO
+ * selects one of them by the first line of the message.
+ */
+void Message::SetLineEnding(LineEnding lineEnding)
+{
+	m_lineEnding = lineEnding;
+}
+
+/*
+ * SetLimits()
+ *
+ * The header size and field count limits, exceeding them while parsing
+ * is a LimitError
+ */
+void Message::SetLimits(const Limits& limits)
+{
+	m_limits = limits;
+}
+
+/*
+ * GetLineEnding()
+ *
+ * The line ending of the message (AUTO is resolved by the first line)
+ */
+DKIM::LineEnding Message::GetLineEnding() const
+{
+	return m_lineEnding;
 }
 
 bool Message::IsDone() const
@@ -84,48 +187,447 @@ bool Message::IsDone() const
 
 bool Message::ParseLine(std::istream& stream)
 {
-	std::string line;
-	if (!std::getline(stream, line))
+	if (!std::getline(stream, m_line))
 	{
-		if (m_tmpHeader.get())
-			m_header.push_back(m_tmpHeader);
-
-		m_bodyOffset = -1;
-		m_done = true;
+		EndOfHeaders(-1);
 		return false;
 	}
 
+	if (!AddLine(m_line, false))
+		EndOfHeaders(stream.tellg());
+
+	return true;
+}
+
+/*
+ * Parse()
+ *
+ * Parse the header of a message in memory, the result is the same as
+ * calling ParseLine() on a stream of the same data until IsDone(). The
+ * header fields are views of data where possible, it must outlive the
+ * message.
+ */
+void Message::Parse(const char* data, size_t size)
+{
+	m_buffer = data;
+	size_t offset = ParseData(data, size, true);
+	if (m_done)
+		return;
+
+	// as tellg(), there is no offset if the line ended at eof
+	if (offset < size)
+		AddLine(std::string_view(data + offset, size - offset), true);
+	if (!m_done)
+		EndOfHeaders(-1);
+}
+
+/*
+ * Scan()
+ *
+ * Parse the header of a message in memory as Parse() does, but keep only
+ * the header fields of the names given (in lowercase, a name ending in *
+ * is a prefix); the others are skipped without being parsed. The body
+ * offset, line ending and limits are the same as those of Parse(). A
+ * dot-stuffed message is parsed in full.
+ */
+void Message::Scan(const char* data, size_t size, const std::vector<std::string_view>& names)
+{
+	if (m_dotStuffed)
+	{
+		Parse(data, size);
+		return;
+	}
+
+	m_buffer = data;
+	if (m_lineEnding == DKIM::DKIM_LE_AUTO)
+	{
+		const char* eol = (const char*)memchr(data, '\n', size);
+		if (eol)
+			m_lineEnding = eol > data && eol[-1] == '\r' ? DKIM::DKIM_LE_CRLF : DKIM::DKIM_LE_LF;
+	}
+
+	// the empty line is either CRLF or LF
+	size_t end = FindEndOfHeaders(data, size);
+	size_t headerSize = end == std::string::npos ? size : end;
+	size_t bodyOffset = end == std::string::npos ? size : end + (data[end] == '\r' ? 2 : 1);
+	CheckHeaderBytes(bodyOffset);
+
+	size_t fields = 0;
+	bool keep = false;
+	for (size_t offset = 0; offset < headerSize; )
+	{
+		const char* eol = (const char*)memchr(data + offset, '\n', headerSize - offset);
+		size_t length = eol ? (size_t)(eol - (data + offset)) : headerSize - offset;
+		std::string_view line(data + offset, length);
+		offset += length + 1;
+
+		if ((line[0] != '\t' && line[0] != ' ') || fields == 0)
+		{
+			if (m_limits.GetMaxHeaderCount() && fields >= m_limits.GetMaxHeaderCount())
+				throw DKIM::LimitError(StringFormat("Header exceeds %zu fields", m_limits.GetMaxHeaderCount()));
+			++fields;
+
+			keep = false;
+			size_t sep = line.find(':');
+			if (sep != std::string_view::npos)
+			{
+				std::string_view name = line.substr(0, sep);
+				size_t first = name.find_first_not_of(" \t");
+				if (first != std::string_view::npos)
+					name = name.substr(first, name.find_last_not_of(" \t") + 1 - first);
+				for (auto want : names)
+				{
+					std::string_view match = name;
+					if (!want.empty() && want.back() == '*')
+					{
+						want.remove_suffix(1);
+						match = name.substr(0, want.size());
+					}
+					if (EqualsNoCase(match, want))
+					{
+						keep = true;
+						break;
+					}
+				}
+			}
+		}
+		if (keep)
+			AddLine(line, true);
+	}
+
+	EndOfHeaders(end == std::string::npos ? -1 : (std::streamoff)bodyOffset);
+}
+
+/*
+ * FindEndOfHeaders()
+ *
+ * The offset of the empty line ending the header, or npos. The body of a
+ * CRLF message is not searched for an LF empty line, and nothing beyond
+ * the header size limit is searched.
+ */
+size_t Message::FindEndOfHeaders(const char* data, size_t size) const
+{
+	size_t limit = m_limits.GetMaxHeaderBytes();
+	if (limit && size > limit)
+		size = limit;
+
+	bool crlf = m_lineEnding == DKIM::DKIM_LE_CRLF;
+	if (size > 0 && data[0] == '\n')
+		return 0;
+	if (crlf && size > 1 && data[0] == '\r' && data[1] == '\n')
+		return 0;
+
+	size_t end = std::string::npos;
+	if (crlf)
+	{
+		const char* found = (const char*)memmem(data, size, "\n\r\n", 3);
+		if (found)
+			end = (size_t)(found - data) + 1;
+	}
+	const char* found = (const char*)memmem(data, end == std::string::npos ? size : end, "\n\n", 2);
+	if (found)
+		end = (size_t)(found - data) + 1;
+	return end;
+}
+
+/*
+ * ParseChunk()
+ *
+ * Parse the next chunk of a message in memory; a line may continue in
+ * the following chunk. The data after the header is ignored, the body
+ * offset is counted from the first chunk.
+ */
+void Message::ParseChunk(const char* data, size_t size)
+{
+	size_t offset = ParseData(data, size, false);
+	if (!m_done && offset < size)
+	{
+		m_line.append(data + offset, size - offset);
+		m_offset += (std::streamoff)(size - offset);
+
+		// a line without end is not buffered beyond the limit
+		CheckHeaderBytes(m_line.size());
+	}
+}
+
+/*
+ * ParseEnd()
+ *
+ * End of the message, the last line may not have been terminated.
+ */
+void Message::ParseEnd()
+{
+	if (m_done)
+		return;
+
+	// as tellg(), there is no offset if the line ended at eof
+	if (!m_line.empty())
+		AddLine(m_line, false);
+	m_line.clear();
+	EndOfHeaders(-1);
+}
+
+/*
+ * ParseData()
+ *
+ * Add the lines ending in data (the first one may have started in a
+ * previous chunk), returns the offset of the unterminated line after
+ * them. If inBuffer, data is the buffer given to Parse().
+ */
+size_t Message::ParseData(const char* data, size_t size, bool inBuffer)
+{
+	size_t offset = 0;
+	while (!m_done && offset < size)
+	{
+		const char* eol = (const char*)memchr(data + offset, '\n', size - offset);
+		if (!eol)
+			break;
+
+		size_t length = (size_t)(eol - (data + offset));
+		std::string_view line(data + offset, length);
+		offset += length + 1;
+		m_offset += (std::streamoff)(length + 1);
+
+		if (!m_line.empty())
+		{
+			m_line.append(line);
+			line = m_line;
+		}
+		if (!AddLine(line, inBuffer && m_line.empty()))
+			EndOfHeaders(m_offset);
+		m_line.clear();
+	}
+	return offset;
+}
+
+/*
+ * AddLine()
+ *
+ * Add one line (without the \n) to the header, returns false if it was
+ * the empty line ending the header. A line in the buffer given to Parse()
+ * that continues a header field right after its CRLF extends the view,
+ * other lines are copied.
+ */
+bool Message::AddLine(std::string_view line, bool inBuffer)
+{
+	CheckHeaderBytes(line.size() + 1);
+	m_headerBytes += line.size() + 1;
+
+	bool cr = line.size() > 0 && line[line.size()-1] == '\r';
+	if (m_lineEnding == DKIM::DKIM_LE_AUTO)
+		m_lineEnding = cr ? DKIM::DKIM_LE_CRLF : DKIM::DKIM_LE_LF;
+
 	// remove possible \r (if not removed by getline *probably not*)
-	if (line.size() > 0 && line[line.size()-1] == '\r')
-		line.erase(line.size()-1);
+	if (cr && m_lineEnding == DKIM::DKIM_LE_CRLF)
+		line.remove_suffix(1);
 
 	if (line.size() == 0)
+		return false;
+
+	if (m_dotStuffed && line[0] == '.')
 	{
-		if (m_tmpHeader.get())
-			m_header.push_back(m_tmpHeader);
-		m_tmpHeader.reset();
+		// end of data, there is no body
+		if (line.size() == 1)
+		{
+			EndOfHeaders(-1);
+			return true;
+		}
+		line.remove_prefix(1);
+	}
 
-		m_bodyOffset = stream.tellg();
-		m_done = true;
+	if ((line[0] != '\t' && line[0] != ' ') || m_fields.empty())
+	{
+		if (m_limits.GetMaxHeaderCount() && m_fields.size() >= m_limits.GetMaxHeaderCount())
+			throw DKIM::LimitError(StringFormat("Header exceeds %zu fields", m_limits.GetMaxHeaderCount()));
 
-		return true;
+		m_fields.emplace_back(m_resource);
+		Header& header = m_fields.back();
+		if (inBuffer)
+			header.m_offset = (size_t)(line.data() - m_buffer);
+		else
+		{
+			header.m_owned = true;
+			header.m_offset = m_storage.size();
+			m_storage.append(line);
+		}
+		header.m_length = line.size();
 	}
-
-	if (line[0] != '\t' && line[0] != ' ')
+	else
 	{
-		if (m_tmpHeader.get())
-			m_header.push_back(m_tmpHeader);
-		m_tmpHeader.reset(new Header());
+		Header& header = m_fields.back();
+		const char* end = header.m_owned || !inBuffer ? nullptr : m_buffer + header.m_offset + header.m_length;
+		if (end && line.data() == end + 2 && end[0] == '\r' && end[1] == '\n')
+			header.m_length += 2 + line.size();
+		else
+		{
+			if (!header.m_owned)
+			{
+				size_t offset = m_storage.size();
+				m_storage.append(m_buffer + header.m_offset, header.m_length);
+				header.m_owned = true;
+				header.m_offset = offset;
+			}
+			m_storage.append("\r\n").append(line);
+			header.m_length += 2 + line.size();
+		}
 	}
 
-	if (!m_tmpHeader.get())
-		m_tmpHeader.reset(new Header());
-	m_tmpHeader->ParseLine(line);
+	Header& header = m_fields.back();
+	if (header.m_valueOffset == 0)
+	{
+		std::string_view field((header.m_owned ? m_storage.data() : m_buffer) + header.m_offset, header.m_length);
+		size_t sep = field.find(':');
+		if (sep != std::string_view::npos)
+		{
+			header.m_valueOffset = sep + 1;
+
+			std::string_view name = field.substr(0, sep);
+			size_t first = name.find_first_not_of(" \t");
+			if (first != std::string_view::npos)
+			{
+				header.m_nameOffset = first;
+				header.m_nameLength = name.find_last_not_of(" \t") + 1 - first;
+				header.m_nameId = DKIM::HeaderName::Lookup(name.substr(first, header.m_nameLength));
+			}
+		}
+	}
 
 	return true;
 }
 
-const std::list<std::shared_ptr<Header> >& Message::GetHeaders() const
+void Message::CheckHeaderBytes(size_t size) const
+{
+	if (m_limits.GetMaxHeaderBytes() && m_headerBytes + size > m_limits.GetMaxHeaderBytes())
+		throw DKIM::LimitError(StringFormat("Header exceeds %zu bytes", m_limits.GetMaxHeaderBytes()));
+}
+
+void Message::EndOfHeaders(std::streamoff bodyOffset)
+{
+	m_bodyOffset = bodyOffset;
+	m_done = true;
+
+	// the fields are in place, resolve their views
+	m_header.clear();
+	m_header.reserve(m_fields.size());
+	for (auto & header : m_fields)
+	{
+		header.m_data = header.m_owned ? m_storage.data() : m_buffer;
+		m_header.push_back(&header);
+	}
+
+	BuildIndex();
+}
+
+/*
+ * BuildIndex()
+ *
+ * Index the header fields by name, the well-known names by their id and
+ * the others in an open addressing table of twice the number of fields;
+ * each name has its fields from the bottom up
+ */
+void Message::BuildIndex()
+{
+	m_index.clear();
+	std::fill(std::begin(m_knownIndex), std::end(m_knownIndex), 0);
+	size_t slots = 16;
+	while (slots < m_header.size() * 2)
+		slots *= 2;
+	m_indexSlots.assign(slots, 0);
+
+	for (auto h = m_header.rbegin(); h != m_header.rend(); ++h)
+	{
+		const Header* header = *h;
+		if (header->GetNameId() != DKIM::HeaderName::UNKNOWN)
+		{
+			size_t& known = m_knownIndex[header->GetNameId()];
+			if (known == 0)
+			{
+				m_index.push_back(IndexEntry { 0, HeaderList(m_resource) });
+				known = m_index.size();
+			}
+			m_index[known - 1].headers.push_back(header);
+			continue;
+		}
+
+		size_t hash = Header::HashName(header->GetName());
+		size_t i = hash & (slots - 1);
+		for (; m_indexSlots[i] != 0; i = (i + 1) & (slots - 1))
+		{
+			IndexEntry& entry = m_index[m_indexSlots[i] - 1];
+			if (entry.hash == hash && EqualsNoCase(entry.headers.front()->GetName(), header->GetName()))
+				break;
+		}
+		if (m_indexSlots[i] == 0)
+		{
+			m_index.push_back(IndexEntry { hash, HeaderList(m_resource) });
+			m_indexSlots[i] = m_index.size();
+		}
+		m_index[m_indexSlots[i] - 1].headers.push_back(header);
+	}
+}
+
+/*
+ * FindIndex()
+ *
+ * The index entry of a header field name (in any case), or npos
+ */
+size_t Message::FindIndex(std::string_view name) const
+{
+	DKIM::HeaderName::Id id = DKIM::HeaderName::Lookup(name);
+	if (id != DKIM::HeaderName::UNKNOWN)
+		return m_knownIndex[id] == 0 ? std::string::npos : m_knownIndex[id] - 1;
+
+	if (m_indexSlots.empty())
+		return std::string::npos;
+	size_t hash = Header::HashName(name);
+	size_t mask = m_indexSlots.size() - 1;
+	for (size_t i = hash & mask; m_indexSlots[i] != 0; i = (i + 1) & mask)
+	{
+		const IndexEntry& entry = m_index[m_indexSlots[i] - 1];
+		if (entry.hash == hash && EqualsNoCase(entry.headers.front()->GetName(), name))
+			return m_indexSlots[i] - 1;
+	}
+	return std::string::npos;
+}
+
+/*
+ * FindHeaders()
+ *
+ * The header fields of a name (in any case) from the bottom up, or
+ * nullptr if there are none
+ */
+const Message::HeaderList* Message::FindHeaders(std::string_view name) const
+{
+	size_t i = FindIndex(name);
+	if (i == std::string::npos)
+		return nullptr;
+	return &m_index[i].headers;
+}
+
+Message::HeaderCursor::HeaderCursor(const Message& msg)
+: m_msg(msg)
+, m_taken(msg.m_index.size(), 0, msg.m_resource)
+{
+}
+
+/*
+ * Next()
+ *
+ * The next header field of a name (in any case), or nullptr if there are
+ * none left
+ */
+const DKIM::Header* Message::HeaderCursor::Next(std::string_view name)
+{
+	size_t i = m_msg.FindIndex(name);
+	if (i == std::string::npos)
+		return nullptr;
+	const HeaderList& headers = m_msg.m_index[i].headers;
+	if (m_taken[i] == headers.size())
+		return nullptr;
+	return headers[m_taken[i]++];
+}
+
+const Message::HeaderList& Message::GetHeaders() const
 {
 	return m_header;
 }
@@ -21,49 +21,145 @@
 #ifndef _DKIM_MAILPARSER_HPP_
 #define _DKIM_MAILPARSER_HPP_
 
+#include "DKIM.hpp"
+#include "Limits.hpp"
+#include "HeaderName.hpp"
+
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <list>
-#include <memory>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
 
 namespace DKIM
 {
+	/*
+	 * A header field of a Message, as offsets into the message. It is a
+	 * view of the caller's buffer if the message was parsed from memory
+	 * and the field is stored there as it is, otherwise of a copy that the
+	 * Message keeps; in both cases it is valid as long as the Message.
+	 * Its canonical forms are allocated from the memory of the Message.
+	 */
 	class Header
 	{
 		public:
-			Header();
-			~Header();
-			bool ParseLine(const std::string& data);
-			const std::string& GetName() const;
-			const std::string& GetHeader() const;
+			Header(std::pmr::memory_resource* resource);
 
+			std::string_view GetName() const
+			{ return std::string_view(m_data + m_offset + m_nameOffset, m_nameLength); }
+			std::string_view GetHeader() const
+			{ return std::string_view(m_data + m_offset, m_length); }
 			size_t GetValueOffset() const
 			{ return m_valueOffset; }
+			HeaderName::Id GetNameId() const
+			{ return m_nameId; }
+
+			bool IsName(std::string_view name) const;
+			bool IsName(HeaderName::Id id) const
+			{ return m_nameId == id; }
+			static size_t HashName(std::string_view name);
+
+			/*
+			 * The header field in canonical form (followed by CRLF), it
+			 * is computed on first use and kept for each mode, for all
+			 * signatures that include the header field; as it allocates
+			 * from the Message, it is not thread-safe (see MessageSource)
+			 */
+			const std::pmr::string& GetCanonical(CanonMode type) const;
 		private:
-			std::string m_name;
-			std::string m_header;
+			friend class Message;
+
+			const char* m_data;
+			bool m_owned;
+			size_t m_offset;
+			size_t m_length;
+			size_t m_nameOffset;
+			size_t m_nameLength;
 			size_t m_valueOffset;
+			HeaderName::Id m_nameId;
+
+			mutable std::pmr::string m_canonical[2];
+			mutable bool m_canonicalized[2];
 	};
 	class Message
 	{
 		public:
-			typedef std::list<std::shared_ptr<Header> > HeaderList;
-			Message();
+			typedef std::pmr::vector<const Header*> HeaderList;
+
+			/*
+			 * Takes the header fields named by a signature in turn, the
+			 * fields of each name from the bottom up (RFC 6376, 5.4.2);
+			 * the message must outlive the cursor
+			 */
+			class HeaderCursor
+			{
+				public:
+					HeaderCursor(const Message& msg);
+					const Header* Next(std::string_view name);
+				private:
+					const Message& m_msg;
+					std::pmr::vector<size_t> m_taken;
+			};
+
+			/*
+			 * All parse state (the header fields, copies of them and the
+			 * name index) is allocated from resource, eg. an Arena
+			 */
+			Message(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 			void Reset();
 			bool IsDone() const;
 			bool ParseLine(std::istream& stream);
+			void Parse(const char* data, size_t size);
+			void Scan(const char* data, size_t size, const std::vector<std::string_view>& names);
+			void ParseChunk(const char* data, size_t size);
+			void ParseEnd();
+			void SetDotStuffed(bool dotStuffed);
+			void SetLineEnding(LineEnding lineEnding);
+			void SetLimits(const Limits& limits);
+			LineEnding GetLineEnding() const;
 			const HeaderList& GetHeaders() const;
+			const HeaderList* FindHeaders(std::string_view name) const;
 			std::streamoff GetBodyOffset() const;
 		private:
-			std::shared_ptr<Header> m_tmpHeader;
+			Message(const Message&);
+			Message& operator=(const Message&);
+
+			size_t ParseData(const char* data, size_t size, bool inBuffer);
+			size_t FindEndOfHeaders(const char* data, size_t size) const;
+			bool AddLine(std::string_view line, bool inBuffer);
+			void CheckHeaderBytes(size_t size) const;
+			void EndOfHeaders(std::streamoff bodyOffset);
+			void BuildIndex();
+			size_t FindIndex(std::string_view name) const;
+
+			std::pmr::memory_resource* m_resource;
 			std::streamoff m_bodyOffset;
 
+			std::pmr::string m_line;
+			std::streamoff m_offset;
+			bool m_dotStuffed;
+			LineEnding m_lineEnding;
+			Limits m_limits;
+			size_t m_headerBytes;
+
+			const char* m_buffer;
+			std::pmr::string m_storage;
+			std::pmr::vector<Header> m_fields;
 			HeaderList m_header;
 			bool m_done;
+
+			struct IndexEntry
+			{
+				size_t hash;
+				HeaderList headers;
+			};
+			std::pmr::vector<IndexEntry> m_index;
+			std::pmr::vector<size_t> m_indexSlots;
+			size_t m_knownIndex[HeaderName::COUNT];
 	};
 }
 
@@ -0,0 +1,356 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "MessageSource.hpp"
+#include "Exception.hpp"
+#include "Util.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using DKIM::MessageSource;
+using DKIM::Util::StringFormat;
+
+const std::vector<std::string_view> MessageSource::ScanNames = { "dkim-signature", "arc-*", "from" };
+
+MessageSource::MessageSource()
+: m_stream(nullptr)
+, m_data("")
+, m_size(0)
+, m_map(nullptr)
+, m_dotStuffed(false)
+, m_lineEnding(DKIM::DKIM_LE_CRLF)
+, m_pipelineThreshold(DefaultPipelineThreshold)
+, m_parsed(false)
+{
+	m_message.emplace(m_arena.GetResource());
+}
+
+MessageSource::MessageSource(std::istream& stream)
+: MessageSource()
+{
+	m_stream = &stream;
+}
+
+MessageSource::MessageSource(const char* data, size_t size)
+: MessageSource()
+{
+	m_data = data;
+	m_size = size;
+}
+
+MessageSource::MessageSource(int fd)
+: MessageSource()
+{
+	Map(fd);
+}
+
+MessageSource::MessageSource(const struct iovec* iov, size_t iovcnt)
+: MessageSource()
+{
+	SetIOVec(iov, iovcnt);
+}
+
+MessageSource::MessageSource(const ChunkReader& chunks)
+: MessageSource()
+{
+	m_data = nullptr;
+	m_chunks = chunks;
+}
+
+MessageSource::~MessageSource()
+{
+	if (m_map)
+		munmap(m_map, m_size);
+}
+
+/*
+ * Reset()
+ *
+ * Replace the message by another one, as if the source was constructed
+ * for it; the settings are kept. The Message of the previous one, and
+ * everything allocated from the arena, may no longer be used. The arena
+ * and the buffers of the source are kept, so that a source reused for
+ * messages of similar size stops allocating.
+ */
+void MessageSource::Reset(std::istream& stream)
+{
+	Clear();
+	m_stream = &stream;
+}
+
+void MessageSource::Reset(const char* data, size_t size)
+{
+	Clear();
+	m_data = data;
+	m_size = size;
+}
+
+void MessageSource::Reset(int fd)
+{
+	Clear();
+	Map(fd);
+}
+
+void MessageSource::Reset(const struct iovec* iov, size_t iovcnt)
+{
+	Clear();
+	SetIOVec(iov, iovcnt);
+}
+
+void MessageSource::Reset(const ChunkReader& chunks)
+{
+	Clear();
+	m_data = nullptr;
+	m_chunks = chunks;
+}
+
+void MessageSource::Clear()
+{
+	if (m_map)
+		munmap(m_map, m_size);
+	m_map = nullptr;
+	m_stream = nullptr;
+	m_data = "";
+	m_size = 0;
+	m_iov.clear();
+	m_chunks = nullptr;
+
+	// the messages are allocated from the arena, they go first
+	m_scan.reset();
+	m_message.reset();
+	m_arena.Reset();
+	m_message.emplace(m_arena.GetResource());
+	m_parsed = false;
+}
+
+void MessageSource::Map(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		throw DKIM::TemporaryError(StringFormat("Could not stat message: %s", strerror(errno)));
+
+	// an empty file can not be mapped
+	if (st.st_size == 0)
+		return;
+
+	void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		throw DKIM::TemporaryError(StringFormat("Could not map message: %s", strerror(errno)));
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	m_map = map;
+	m_data = (const char*)map;
+	m_size = (size_t)st.st_size;
+}
+
+void MessageSource::SetIOVec(const struct iovec* iov, size_t iovcnt)
+{
+	m_data = nullptr;
+	m_iov.assign(iov, iov + iovcnt);
+	m_chunks = [this] (size_t index, const char*& data, size_t& size) {
+		if (index >= m_iov.size())
+			return false;
+		data = (const char*)m_iov[index].iov_base;
+		size = m_iov[index].iov_len;
+		return true;
+	};
+}
+
+/*
+ * CheckUnparsed()
+ *
+ * The header must not have been parsed or scanned yet, it would be kept
+ * with the previous settings
+ */
+void MessageSource::CheckUnparsed() const
+{
+	if (m_parsed || m_scan)
+		throw std::logic_error("The message source has been parsed already; it must be reset before it is changed");
+}
+
+void MessageSource::SetDotStuffed(bool dotStuffed)
+{
+	CheckUnparsed();
+	m_dotStuffed = dotStuffed;
+}
+
+void MessageSource::SetLineEnding(LineEnding lineEnding)
+{
+	CheckUnparsed();
+	m_lineEnding = lineEnding;
+}
+
+void MessageSource::SetLimits(const Limits& limits)
+{
+	CheckUnparsed();
+	m_limits = limits;
+}
+
+/*
+ * ParseHeaders()
+ *
+ * The message header (from the beginning of the source), it is parsed by
+ * the first call
+ */
+const DKIM::Message& MessageSource::ParseHeaders()
+{
+	if (!m_parsed)
+	{
+		ParseMessage();
+		m_parsed = true;
+	}
+	return *m_message;
+}
+
+/*
+ * ScanHeaders()
+ *
+ * The header fields named by ScanNames (or all of them if the source is
+ * not in memory or has been parsed already), it is scanned by the first
+ * call and kept, so that the fields are the same for all validators on
+ * the source. The body offset and line ending are those of ParseHeaders().
+ */
+const DKIM::Message& MessageSource::ScanHeaders()
+{
+	if (m_scan)
+		return *m_scan;
+	if (m_parsed || m_stream || m_chunks || m_dotStuffed)
+		return ParseHeaders();
+
+	m_scan.emplace(m_arena.GetResource());
+	m_scan->SetLineEnding(m_lineEnding);
+	m_scan->SetLimits(m_limits);
+	try {
+		m_scan->Scan(m_data, m_size, ScanNames);
+	} catch (...) {
+		// a failed scan is not kept
+		m_scan.reset();
+		throw;
+	}
+	return *m_scan;
+}
+
+void MessageSource::ParseMessage()
+{
+	Message& msg = *m_message;
+	msg.SetDotStuffed(m_dotStuffed);
+	msg.SetLineEnding(m_lineEnding);
+	msg.SetLimits(m_limits);
+	if (m_stream)
+	{
+		while (msg.ParseLine(*m_stream) && !msg.IsDone()) { }
+		return;
+	}
+	if (m_chunks)
+	{
+		const char* data;
+		size_t size;
+		for (size_t i = 0; !msg.IsDone() && m_chunks(i, data, size); ++i)
+			msg.ParseChunk(data, size);
+		msg.ParseEnd();
+		return;
+	}
+	msg.Parse(m_data, m_size);
+}
+
+/*
+ * ReadBody()
+ *
+ * Pass the body starting at bodyOffset (-1 if there is none) to func,
+ * in one or more chunks, until func returns false.
+ */
+void MessageSource::ReadBody(std::streamoff bodyOffset, const BodyReader& func)
+{
+	if (bodyOffset == -1)
+		return;
+
+	if (m_stream)
+	{
+		m_stream->clear();
+		m_stream->seekg(bodyOffset, std::istream::beg);
+
+		while (m_stream->good())
+		{
+			char buffer[8096];
+			m_stream->read(buffer, sizeof buffer);
+			if (!func(buffer, (size_t)m_stream->gcount()))
+				break;
+		}
+		return;
+	}
+
+	if (m_chunks)
+	{
+		// skip the chunks (and the part of a chunk) before the body
+		size_t offset = 0;
+		const char* data;
+		size_t size;
+		for (size_t i = 0; m_chunks(i, data, size); ++i)
+		{
+			size_t skip = 0;
+			if (offset < (size_t)bodyOffset)
+				skip = std::min(size, (size_t)bodyOffset - offset);
+			offset += size;
+			if (skip < size && !func(data + skip, size - skip))
+				break;
+		}
+		return;
+	}
+
+	if ((size_t)bodyOffset < m_size)
+		func(m_data + bodyOffset, m_size - (size_t)bodyOffset);
+}
+
+/*
+ * UsePipeline()
+ *
+ * If the body starting at bodyOffset is large enough to be hashed in
+ * pipelined threads
+ */
+bool MessageSource::UsePipeline(std::streamoff bodyOffset)
+{
+	if (m_pipelineThreshold == 0 || bodyOffset == -1 || std::thread::hardware_concurrency() < 2)
+		return false;
+
+	size_t size = m_size;
+	if (m_stream)
+	{
+		m_stream->clear();
+		m_stream->seekg(0, std::istream::end);
+		std::streamoff end = m_stream->tellg();
+		if (end == -1)
+			return false;
+		size = (size_t)end;
+	}
+	else if (m_chunks)
+	{
+		const char* data;
+		size_t length;
+		for (size_t i = 0; m_chunks(i, data, length); ++i)
+			size += length;
+	}
+	return size >= (size_t)bodyOffset && size - (size_t)bodyOffset >= m_pipelineThreshold;
+}
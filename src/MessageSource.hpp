@@ -0,0 +1,154 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_MESSAGESOURCE_HPP_
+#define _DKIM_MESSAGESOURCE_HPP_
+
+#include "MailParser.hpp"
+#include "Arena.hpp"
+
+#include <istream>
+#include <vector>
+#include <functional>
+#include <optional>
+#include <sys/uio.h>
+
+namespace DKIM
+{
+	/*
+	 * The raw message to sign or validate; either a stream, a buffer in
+	 * memory (owned by the caller), a file descriptor that is mapped
+	 * read-only for the lifetime of the object (the descriptor itself may
+	 * be closed) or a chain of chunks; a default constructed source is an
+	 * empty message. Buffers, mapped files and chunks are parsed and
+	 * canonicalized in place, without being copied through a streambuf.
+	 *
+	 * Chunks are given as an iovec array or by a callback that returns
+	 * chunk number index (in data and size), or false if there are no more
+	 * chunks; they are read more than once, and must stay valid for the
+	 * lifetime of the object. Lines and CRLFs may straddle chunks.
+	 *
+	 * SetDotStuffed() marks the message as SMTP DATA that has not been
+	 * unstuffed yet; it is done while parsing and canonicalizing, and the
+	 * message ends at the terminating "." line.
+	 *
+	 * SetLineEnding() selects how lines end (see Message::SetLineEnding),
+	 * after ParseHeaders() the message has the line ending in effect.
+	 *
+	 * The header is parsed once, by the first ParseHeaders(), and the
+	 * Message is kept by the source; validators and signers on one source
+	 * share it, and with it the canonicalized header fields, so that each
+	 * is canonicalized at most once per mode. The dot stuffing, line
+	 * ending and limits are set before that; setting them once the header
+	 * has been parsed or scanned throws std::logic_error (Reset() the
+	 * source first). Header fields of a source in memory are views of it.
+	 *
+	 * As the Arena and the canonicalized header fields are filled on
+	 * demand, the source and the validators and signers on it must not be
+	 * used from more than one thread at a time; sources are independent.
+	 *
+	 * ScanHeaders() is a faster alternative for when only the signatures
+	 * are needed, eg. to list them: the header of a source in memory is
+	 * scanned for the end of the header and for the fields named by
+	 * ScanNames (see Message::Scan), the full parse is deferred until
+	 * ParseHeaders(). Other sources are parsed in full.
+	 *
+	 * The parse state of the message is allocated from an Arena kept by
+	 * the source (see GetResource()), and freed with it. A source may be
+	 * reused for another message with Reset(), see there.
+	 *
+	 * SetLimits() sets the resource limits for the message (see Limits),
+	 * those of the header are enforced by ParseHeaders(), the others by
+	 * the validators on the source. A new source has the default limits.
+	 *
+	 * Bodies of at least the pipeline threshold (0 disables it) are hashed
+	 * in other threads while being read and canonicalized, if there is
+	 * more than one CPU.
+	 */
+	class MessageSource
+	{
+		public:
+			typedef std::function<bool(const char* data, size_t size)> BodyReader;
+			typedef std::function<bool(size_t index, const char*& data, size_t& size)> ChunkReader;
+
+			MessageSource();
+			MessageSource(std::istream& stream);
+			MessageSource(const char* data, size_t size);
+			MessageSource(int fd);
+			MessageSource(const struct iovec* iov, size_t iovcnt);
+			MessageSource(const ChunkReader& chunks);
+			~MessageSource();
+
+			void Reset(std::istream& stream);
+			void Reset(const char* data, size_t size);
+			void Reset(int fd);
+			void Reset(const struct iovec* iov, size_t iovcnt);
+			void Reset(const ChunkReader& chunks);
+
+			void SetDotStuffed(bool dotStuffed);
+			bool IsDotStuffed() const
+			{ return m_dotStuffed; }
+			void SetLineEnding(LineEnding lineEnding);
+			void SetLimits(const Limits& limits);
+			const Limits& GetLimits() const
+			{ return m_limits; }
+			void SetPipelineThreshold(size_t threshold)
+			{ m_pipelineThreshold = threshold; }
+			bool UsePipeline(std::streamoff bodyOffset);
+
+			static const size_t DefaultPipelineThreshold = 8 * 1024 * 1024;
+
+			std::pmr::memory_resource* GetResource()
+			{ return m_arena.GetResource(); }
+
+			static const std::vector<std::string_view> ScanNames;
+
+			const Message& ParseHeaders();
+			const Message& ScanHeaders();
+			void ReadBody(std::streamoff bodyOffset, const BodyReader& func);
+		private:
+			MessageSource(const MessageSource&);
+			MessageSource& operator=(const MessageSource&);
+
+			void Clear();
+			void CheckUnparsed() const;
+			void Map(int fd);
+			void SetIOVec(const struct iovec* iov, size_t iovcnt);
+			void ParseMessage();
+
+			std::istream* m_stream;
+			const char* m_data;
+			size_t m_size;
+			void* m_map;
+			std::vector<struct iovec> m_iov;
+			ChunkReader m_chunks;
+			bool m_dotStuffed;
+			LineEnding m_lineEnding;
+			Limits m_limits;
+			size_t m_pipelineThreshold;
+
+			Arena m_arena;
+			std::optional<Message> m_message;
+			bool m_parsed;
+			std::optional<Message> m_scan;
+	};
+}
+
+#endif
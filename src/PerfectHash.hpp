@@ -0,0 +1,125 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_PERFECTHASH_HPP_
+#define _DKIM_PERFECTHASH_HPP_
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace DKIM {
+	/*
+	 * A perfect hash of a fixed list of names, built at compile time: the
+	 * FNV-1a seed is the first one for which no two names share a slot of
+	 * the table. The first name is the empty name, and is the index of any
+	 * name that is not in the list.
+	 */
+	template<size_t Count, size_t TableSize, bool IgnoreCase>
+	class PerfectHash
+	{
+		static_assert(Count <= 256, "an index fits in a slot");
+		static_assert((TableSize & (TableSize - 1)) == 0, "a power of two table");
+
+		public:
+			constexpr PerfectHash(const std::string_view (&names)[Count])
+			: m_names(names), m_seed(FindSeed(names)), m_table(), m_maxLength(0)
+			{
+				for (size_t i = 1; i < Count; ++i)
+				{
+					m_table[Hash(m_seed, names[i]) & (TableSize - 1)] = (uint8_t)i;
+					if (names[i].size() > m_maxLength)
+						m_maxLength = names[i].size();
+				}
+			}
+
+			/*
+			 * Lookup()
+			 *
+			 * The index of name in the list, or 0 if it is not in it
+			 */
+			constexpr size_t Lookup(std::string_view name) const
+			{
+				if (name.empty() || name.size() > m_maxLength)
+					return 0;
+				size_t index = m_table[Hash(m_seed, name) & (TableSize - 1)];
+				std::string_view known = m_names[index];
+				if (known.size() != name.size())
+					return 0;
+				for (size_t i = 0; i < name.size(); ++i)
+					if (Fold(name[i]) != known[i])
+						return 0;
+				return index;
+			}
+
+			/*
+			 * Name()
+			 *
+			 * The name of an index, empty if it is out of range
+			 */
+			constexpr std::string_view Name(size_t index) const
+			{
+				return index < Count ? m_names[index] : std::string_view();
+			}
+		private:
+			static constexpr char Fold(char c)
+			{
+				return IgnoreCase && c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+			}
+
+			static constexpr uint32_t Hash(uint32_t seed, std::string_view name)
+			{
+				uint32_t hash = 2166136261u ^ seed;
+				for (char c : name)
+				{
+					hash ^= (unsigned char)Fold(c);
+					hash *= 16777619u;
+				}
+				return hash ^ (hash >> 15);
+			}
+
+			static constexpr bool IsPerfect(const std::string_view (&names)[Count], uint32_t seed)
+			{
+				bool used[TableSize] = {};
+				for (size_t i = 1; i < Count; ++i)
+				{
+					size_t slot = Hash(seed, names[i]) & (TableSize - 1);
+					if (used[slot])
+						return false;
+					used[slot] = true;
+				}
+				return true;
+			}
+
+			static constexpr uint32_t FindSeed(const std::string_view (&names)[Count])
+			{
+				for (uint32_t seed = 0; ; ++seed)
+					if (IsPerfect(names, seed))
+						return seed;
+			}
+
+			const std::string_view* m_names;
+			uint32_t m_seed;
+			uint8_t m_table[TableSize];
+			size_t m_maxLength;
+	};
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "Pipeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using DKIM::Conversion::Pipeline;
+
+Pipeline::Pipeline(size_t buffers, size_t bufferSize)
+: m_buffers(buffers)
+, m_bufferSize(bufferSize)
+, m_published(0)
+, m_acquired(false)
+, m_closed(false)
+{
+	for (auto & buffer : m_buffers)
+	{
+		buffer.data.reset(new char[bufferSize]);
+		buffer.size = 0;
+	}
+}
+
+Pipeline::~Pipeline()
+{
+	Close();
+}
+
+void Pipeline::AddConsumer(const Consumer& func)
+{
+	std::unique_ptr<Worker> worker(new Worker);
+	worker->func = func;
+	worker->done = 0;
+	worker->thread = std::thread(&Pipeline::Run, this, std::ref(*worker));
+	m_workers.push_back(std::move(worker));
+}
+
+void Pipeline::Write(const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		if (!m_acquired)
+		{
+			// wait for the buffer to be consumed by all workers (from its previous round)
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_consumed.wait(lock, [this] {
+				for (const auto & worker : m_workers)
+					if (worker->done + m_buffers.size() <= m_published)
+						return false;
+				return true;
+			});
+			m_buffers[m_published % m_buffers.size()].size = 0;
+			m_acquired = true;
+		}
+
+		Buffer& buffer = m_buffers[m_published % m_buffers.size()];
+		size_t length = std::min(size, m_bufferSize - buffer.size);
+		memcpy(buffer.data.get() + buffer.size, data, length);
+		buffer.size += length;
+		data += length;
+		size -= length;
+
+		if (buffer.size == m_bufferSize)
+			Publish();
+	}
+}
+
+void Pipeline::Publish()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	++m_published;
+	m_acquired = false;
+	m_written.notify_all();
+}
+
+void Pipeline::Close()
+{
+	if (m_closed)
+		return;
+
+	if (m_acquired && m_buffers[m_published % m_buffers.size()].size > 0)
+		Publish();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_written.notify_all();
+	}
+	for (auto & worker : m_workers)
+		worker->thread.join();
+}
+
+void Pipeline::Run(Worker& worker)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_written.wait(lock, [this, &worker] { return m_closed || worker.done < m_published; });
+			if (worker.done == m_published)
+				return;
+		}
+
+		Buffer& buffer = m_buffers[worker.done % m_buffers.size()];
+		worker.func(buffer.data.get(), buffer.size);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++worker.done;
+			m_consumed.notify_one();
+		}
+	}
+}
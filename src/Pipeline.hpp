@@ -0,0 +1,89 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_PIPELINE_HPP_
+#define _DKIM_PIPELINE_HPP_
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace DKIM {
+	namespace Conversion {
+		/*
+		 * Passes data from one producer to one or more consumer threads
+		 * through a ring of buffers; every consumer gets all data, in order,
+		 * in chunks of up to bufferSize bytes. The producer blocks when
+		 * all buffers are still being consumed.
+		 *
+		 * All consumers are added before the first Write(), Close() flushes
+		 * the last buffer and waits for the consumers to finish.
+		 */
+		class Pipeline
+		{
+			public:
+				typedef std::function<void(const char* data, size_t size)> Consumer;
+
+				Pipeline(size_t buffers = 8, size_t bufferSize = 64 * 1024);
+				~Pipeline();
+
+				void AddConsumer(const Consumer& func);
+
+				void Write(const char* data, size_t size);
+				void Close();
+
+				void operator()(const char* data, size_t size)
+				{ Write(data, size); }
+			private:
+				Pipeline(const Pipeline&);
+
+				struct Buffer
+				{
+					std::unique_ptr<char[]> data;
+					size_t size;
+				};
+				struct Worker
+				{
+					Consumer func;
+					size_t done;
+					std::thread thread;
+				};
+
+				void Publish();
+				void Run(Worker& worker);
+
+				std::vector<Buffer> m_buffers;
+				size_t m_bufferSize;
+				std::vector<std::unique_ptr<Worker>> m_workers;
+
+				std::mutex m_mutex;
+				std::condition_variable m_written;
+				std::condition_variable m_consumed;
+				size_t m_published;
+				bool m_acquired;
+				bool m_closed;
+		};
+	}
+}
+
+#endif
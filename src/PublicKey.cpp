@@ -19,6 +19,7 @@
  *
  */
 #include "PublicKey.hpp"
+#include "TagName.hpp"
 
 #include "Base64.hpp"
 #include "Tokenizer.hpp"
@@ -59,65 +60,72 @@ void PublicKey::Parse(const std::string& signature)
 	 */
 
 	// Version
-	TagListEntry v;
-	if (m_tagList.GetTag("v", v))
+	const TagListEntry* v = m_tagList.GetTag(DKIM::TagName::V);
+	if (v)
 	{
-		if (v.GetValue() != "DKIM1")
+		if (DKIM::TagValue::Lookup(v->GetValue()) != DKIM::TagValue::DKIM1)
 			throw DKIM::PermanentError(StringFormat("Unsupported version %s (v supports DKIM1)",
-						v.GetValue().c_str()
+						std::string(v->GetValue()).c_str()
 						)
 					);
 	}
 
 	// Acceptable hash algorithms
-	TagListEntry h;
-	if (m_tagList.GetTag("h", h))
+	const TagListEntry* h = m_tagList.GetTag(DKIM::TagName::H);
+	if (h)
 	{
-		if (h.GetValue().empty())
+		if (h->GetValue().empty())
 			throw DKIM::PermanentError("Acceptable hash algorithms is empty (h)");
 
-		std::list<std::string> algo = DKIM::Tokenizer::ValueList(h.GetValue());
-		for (std::list<std::string>::const_iterator a = algo.begin();
-				a != algo.end(); ++a)
+		for (std::string_view algo : DKIM::Tokenizer::ValueList(h->GetValue()))
 		{
-			if (*a == "sha256")
-				m_digestAlgorithms.push_back(DKIM_A_SHA256);
-			else if (*a == "sha1")
-				m_digestAlgorithms.push_back(DKIM_A_SHA1);
+			switch (DKIM::TagValue::Lookup(algo))
+			{
+				case DKIM::TagValue::SHA256:
+					m_digestAlgorithms.push_back(DKIM_A_SHA256);
+					break;
+				case DKIM::TagValue::SHA1:
+					m_digestAlgorithms.push_back(DKIM_A_SHA1);
+					break;
+				default:
+					break;
+			}
 		}
 	}
 
 	// Key type
-	TagListEntry k;
-	if (m_tagList.GetTag("k", k))
+	const TagListEntry* k = m_tagList.GetTag(DKIM::TagName::K);
+	if (k)
 	{
-		if (k.GetValue() == "rsa")
-			m_signatureAlgorithm = DKIM_SA_RSA;
-		else if (k.GetValue() == "ed25519")
-			m_signatureAlgorithm = DKIM_SA_ED25519;
-		else
-			throw DKIM::PermanentError(StringFormat("Unsupported key type %s (k supports rsa and ed25519)",
-						k.GetValue().c_str()
-						)
-					);
+		switch (DKIM::TagValue::Lookup(k->GetValue()))
+		{
+			case DKIM::TagValue::RSA:
+				m_signatureAlgorithm = DKIM_SA_RSA;
+				break;
+			case DKIM::TagValue::ED25519:
+				m_signatureAlgorithm = DKIM_SA_ED25519;
+				break;
+			default:
+				throw DKIM::PermanentError(StringFormat("Unsupported key type %s (k supports rsa and ed25519)",
+							std::string(k->GetValue()).c_str()
+							)
+						);
+		}
 	}
 
 	// Public-key data
-	TagListEntry p;
-	if (!m_tagList.GetTag("p", p))
+	const TagListEntry* p = m_tagList.GetTag(DKIM::TagName::P);
+	if (!p)
 		throw DKIM::PermanentError("Missing public key (p)");
 
-	if (p.GetValue().empty())
+	if (p->GetValue().empty())
 		throw DKIM::PermanentError("Public key is revoked (p)");
 
-	std::string ptmp = p.GetValue();
-	ptmp.erase(remove_if(ptmp.begin(), ptmp.end(), isspace), ptmp.end());
-
 	switch (m_signatureAlgorithm)
 	{
 		case DKIM_SA_RSA:
 		{
-			std::string tmp = Base64_Decode(ptmp);
+			std::string tmp = Base64_Decode(p->GetValue());
 			const unsigned char *tmp2 = (const unsigned char*)tmp.c_str();
 			EVP_PKEY* publicKey = d2i_PUBKEY(nullptr, &tmp2, tmp.size());
 
@@ -140,7 +148,7 @@ void PublicKey::Parse(const std::string& signature)
 		break;
 		case DKIM_SA_ED25519:
 		{
-			std::string tmp = Base64_Decode(ptmp);
+			std::string tmp = Base64_Decode(p->GetValue());
 			if (tmp.size() != 32)
 				throw DKIM::PermanentError("Public ed25519 key could not be loaded");
 			m_publicKeyED25519 = tmp;
@@ -149,19 +157,18 @@ void PublicKey::Parse(const std::string& signature)
 	}
 
 	// Service Type
-	TagListEntry s;
-	if (m_tagList.GetTag("s", s))
+	const TagListEntry* s = m_tagList.GetTag(DKIM::TagName::S);
+	if (s)
 	{
-		if (s.GetValue().empty())
+		if (s->GetValue().empty())
 			throw DKIM::PermanentError("Service type is empty (s)");
 
-		std::list<std::string> type = DKIM::Tokenizer::ValueList(s.GetValue());
-		for (std::list<std::string>::const_iterator a = type.begin();
-				a != type.end(); ++a)
+		for (std::string_view type : DKIM::Tokenizer::ValueList(s->GetValue()))
 		{
-			if (*a == "email")
+			DKIM::TagValue::Id service = DKIM::TagValue::Lookup(type);
+			if (service == DKIM::TagValue::EMAIL)
 				m_serviceType.push_back(DKIM_S_EMAIL);
-			else if (*a == "*")
+			else if (service == DKIM::TagValue::ANY)
 			{
 				m_serviceType.clear();
 				break;
@@ -170,10 +177,10 @@ void PublicKey::Parse(const std::string& signature)
 	}
 
 	// Flags
-	TagListEntry t;
-	if (m_tagList.GetTag("t", t))
+	const TagListEntry* t = m_tagList.GetTag(DKIM::TagName::T);
+	if (t)
 	{
-		m_flags = DKIM::Tokenizer::ValueList(t.GetValue());
+		m_flags = DKIM::Tokenizer::ValueList(t->GetValue(), m_flags.get_allocator().resource());
 	}
 
 	return;
@@ -26,6 +26,9 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <string_view>
+#include <memory_resource>
 #include <stdexcept>
 #include <algorithm>
 
@@ -37,8 +40,8 @@ namespace DKIM {
 		public:
 			typedef enum { DKIM_S_EMAIL } ServiceType;
 
-			PublicKey()
-			: m_publicKeyRSA(nullptr)
+			PublicKey(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_tagList(resource), m_publicKeyRSA(nullptr), m_flags(resource)
 			{ Reset(); }
 
 			~PublicKey()
@@ -64,7 +67,10 @@ namespace DKIM {
 			const std::list<ServiceType>& GetServiceType() const
 			{ return m_serviceType; }
 
-			const std::list<std::string>& GetFlags() const
+			/*
+			 * The flags are views of the tag list, as long as the key
+			 */
+			const std::pmr::vector<std::string_view>& GetFlags() const
 			{ return m_flags; }
 
 			bool SoftFail() const
@@ -83,7 +89,7 @@ namespace DKIM {
 			std::string m_publicKeyED25519;
 			SignatureAlgorithm m_signatureAlgorithm;
 			std::list<ServiceType> m_serviceType;
-			std::list<std::string> m_flags;
+			std::pmr::vector<std::string_view> m_flags;
 	};
 }
 
@@ -24,9 +24,13 @@
 using DKIM::Signatory;
 
 #include "Canonicalization.hpp"
+#include "Pipeline.hpp"
 
 using DKIM::Conversion::CanonicalizationHeader;
-using DKIM::Conversion::CanonicalizationBody;
+using DKIM::Conversion::EVPDigest;
+using DKIM::Conversion::BodyCanonicalizer;
+using DKIM::Conversion::DataSink;
+using DKIM::Conversion::Pipeline;
 
 #include "QuotedPrintable.hpp"
 #include "Base64.hpp"
@@ -42,69 +46,191 @@ using DKIM::Util::StringFormat;
 #include <algorithm>
 #include <map>
 #include <set>
+#include <bitset>
 
-Signatory::Signatory(std::istream& file)
-: m_file(file)
+Signatory::Signatory(std::istream& file, const Limits& limits)
+: m_ownedSource(new DKIM::MessageSource(file))
+, m_source(m_ownedSource.get())
 {
+	m_ownedSource->SetLimits(limits);
+	CreateContexts();
+}
+
+Signatory::Signatory(const char* data, size_t size, const Limits& limits)
+: m_ownedSource(new DKIM::MessageSource(data, size))
+, m_source(m_ownedSource.get())
+{
+	m_ownedSource->SetLimits(limits);
+	CreateContexts();
+}
+
+Signatory::Signatory(int fd, const Limits& limits)
+: m_ownedSource(new DKIM::MessageSource(fd))
+, m_source(m_ownedSource.get())
+{
+	m_ownedSource->SetLimits(limits);
+	CreateContexts();
+}
+
+Signatory::Signatory(const struct iovec* iov, size_t iovcnt, const Limits& limits)
+: m_ownedSource(new DKIM::MessageSource(iov, iovcnt))
+, m_source(m_ownedSource.get())
+{
+	m_ownedSource->SetLimits(limits);
+	CreateContexts();
+}
+
+Signatory::Signatory(const MessageSource::ChunkReader& chunks, const Limits& limits)
+: m_ownedSource(new DKIM::MessageSource(chunks))
+, m_source(m_ownedSource.get())
+{
+	m_ownedSource->SetLimits(limits);
+	CreateContexts();
+}
+
+Signatory::Signatory(MessageSource& source)
+: m_source(&source)
+{
+	CreateContexts();
 }
 
 Signatory::~Signatory()
 {
 }
 
+/*
+ * Reset()
+ *
+ * Sign another message, as if the signer was constructed for it. The
+ * digest contexts and the source (if the signer owns one) of the previous
+ * message are reused.
+ */
+void Signatory::Reset(std::istream& file, const Limits& limits)
+{
+	OwnedSource().Reset(file);
+	m_ownedSource->SetLimits(limits);
+}
+
+void Signatory::Reset(const char* data, size_t size, const Limits& limits)
+{
+	OwnedSource().Reset(data, size);
+	m_ownedSource->SetLimits(limits);
+}
+
+void Signatory::Reset(int fd, const Limits& limits)
+{
+	OwnedSource().Reset(fd);
+	m_ownedSource->SetLimits(limits);
+}
+
+void Signatory::Reset(const struct iovec* iov, size_t iovcnt, const Limits& limits)
+{
+	OwnedSource().Reset(iov, iovcnt);
+	m_ownedSource->SetLimits(limits);
+}
+
+void Signatory::Reset(const MessageSource::ChunkReader& chunks, const Limits& limits)
+{
+	OwnedSource().Reset(chunks);
+	m_ownedSource->SetLimits(limits);
+}
+
+void Signatory::Reset(MessageSource& source)
+{
+	m_source = &source;
+}
+
+DKIM::MessageSource& Signatory::OwnedSource()
+{
+	if (!m_ownedSource)
+		m_ownedSource.reset(new DKIM::MessageSource());
+	m_source = m_ownedSource.get();
+	return *m_ownedSource;
+}
+
+void Signatory::CreateContexts()
+{
+	for (EVPContext* ctx : { &m_evpBody, &m_evpHead, &m_evpSign })
+		*ctx = EVPContext(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
+}
+
 std::string Signatory::CreateSignature(const SignatoryOptions& options)
 {
-	while (m_msg.ParseLine(m_file) && !m_msg.IsDone()) { }
+	const DKIM::Message& msg = m_source->ParseHeaders();
 
 	// create signature for our body (message data)
-	std::unique_ptr<EVP_MD_CTX, std::function<void(EVP_MD_CTX*)>> evpmdbody(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
+	EVP_MD_CTX* evpmdbody = m_evpBody.get();
 	switch (options.GetDigestAlgorithm())
 	{
 		case DKIM::DKIM_A_SHA1:
-			EVP_DigestInit_ex(evpmdbody.get(), EVP_sha1(), nullptr);
+			EVP_DigestInit_ex(evpmdbody, EVP_sha1(), nullptr);
 			break;
 		case DKIM::DKIM_A_SHA256:
-			EVP_DigestInit_ex(evpmdbody.get(), EVP_sha256(), nullptr);
+			EVP_DigestInit_ex(evpmdbody, EVP_sha256(), nullptr);
 			break;
 	}
 
-	DKIM::Conversion::EVPDigest evpupd;
-	evpupd.ctx = evpmdbody.get();
+	EVPDigest evpupd;
+	evpupd.ctx = evpmdbody;
+
+	// a large body is hashed in another thread while it is read
+	std::unique_ptr<Pipeline> pipeline;
+	if (m_source->UsePipeline(msg.GetBodyOffset()))
+	{
+		pipeline.reset(new Pipeline);
+		pipeline->AddConsumer(evpupd);
+	}
 
-	if (!CanonicalizationBody(m_file,
-			options.GetCanonModeBody(),
-			m_msg.GetBodyOffset(),
+	BodyCanonicalizer canonicalbody(options.GetCanonModeBody(),
 			options.GetBodySignLength(),
 			options.GetBodyLength(),
-			std::bind(&DKIM::Conversion::EVPDigest::update, &evpupd, std::placeholders::_1, std::placeholders::_2)))
+			pipeline ? DataSink(*pipeline) : DataSink(evpupd),
+			m_source->IsDotStuffed(),
+			msg.GetLineEnding());
+	m_source->ReadBody(msg.GetBodyOffset(), [&canonicalbody] (const char* data, size_t size) {
+		canonicalbody.Update(data, size);
+		return !canonicalbody.IsDone();
+	});
+	bool complete = canonicalbody.Final();
+	if (pipeline)
+		pipeline->Close();
+	if (!complete)
 		throw DKIM::PermanentError("Body sign limit exceed the size of the canonicalized message length");
 
 	unsigned char md[EVP_MAX_MD_SIZE];
 	unsigned int md_len;
-	EVP_DigestFinal_ex(evpmdbody.get(), md, &md_len);
+	EVP_DigestFinal_ex(evpmdbody, md, &md_len);
 
 	std::string bh((char*)md, md_len);
 
 	// create signature for our header
-	std::unique_ptr<EVP_MD_CTX, std::function<void(EVP_MD_CTX*)>> evpmdhead(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
+	EVP_MD_CTX* evpmdhead = m_evpHead.get();
 	int md_nid;
 	switch (options.GetDigestAlgorithm())
 	{
 		case DKIM::DKIM_A_SHA1:
-			EVP_DigestInit_ex(evpmdhead.get(), EVP_sha1(), nullptr);
+			EVP_DigestInit_ex(evpmdhead, EVP_sha1(), nullptr);
 			md_nid = NID_sha1;
 			break;
 		case DKIM::DKIM_A_SHA256:
-			EVP_DigestInit_ex(evpmdhead.get(), EVP_sha256(), nullptr);
+			EVP_DigestInit_ex(evpmdhead, EVP_sha256(), nullptr);
 			md_nid = NID_sha256;
 			break;
 	}
 
 	CanonicalizationHeader canonicalhead(options.GetCanonModeHeader());
 
+	// the well-known names are selected by their id, the others by name
+	std::bitset<HeaderName::COUNT> knownToSign;
 	std::set<std::string> headersToSign;
 	for (auto name : options.GetHeaders())
 	{
+		HeaderName::Id id = HeaderName::Lookup(name);
+		if (id != HeaderName::UNKNOWN)
+		{
+			knownToSign.set(id);
+			continue;
+		}
 		transform(name.begin(), name.end(), name.begin(), tolower);
 		headersToSign.insert(name);
 	}
@@ -112,24 +238,31 @@ std::string Signatory::CreateSignature(const SignatoryOptions& options)
 	std::list<std::string> signedHeaders;
 
 	bool signAll = false;
-	if (headersToSign.empty()) signAll = true;
+	if (knownToSign.none() && headersToSign.empty()) signAll = true;
 
 	// add all headers to our cache (they will be pop of the end)
-	const auto & headers = m_msg.GetHeaders();
+	const auto & headers = msg.GetHeaders();
+	std::string name;
 	for (auto h = headers.rbegin(); h != headers.rend(); ++h)
 	{
-		std::string name = (*h)->GetName();
+		HeaderName::Id id = (*h)->GetNameId();
+		if (id != HeaderName::UNKNOWN)
+		{
+			if (!signAll && !knownToSign.test(id))
+				continue;
+			canonicalhead.WriteHeader(**h, EVPDigest { evpmdhead }, true);
+			signedHeaders.emplace_back(HeaderName::Name(id));
+			continue;
+		}
+
+		name.assign((*h)->GetName());
 		transform(name.begin(), name.end(), name.begin(), tolower);
 		if (!name.empty())
 		{
 			if (!signAll && headersToSign.find(name) == headersToSign.end())
 				continue;
-			std::string tmp = canonicalhead.FilterHeader((*h)->GetHeader()) + "\r\n";
-			if (!tmp.empty())
-			{
-				EVP_DigestUpdate(evpmdhead.get(), tmp.c_str(), tmp.size());
-				signedHeaders.push_back(name);
-			}
+			canonicalhead.WriteHeader(**h, EVPDigest { evpmdhead }, true);
+			signedHeaders.push_back(name);
 		}
 	}
 	auto oversign = options.GetOversignHeaders();
@@ -193,16 +326,14 @@ std::string Signatory::CreateSignature(const SignatoryOptions& options)
 		dkimHeader += "\tbh=" + Base64_Encode(bh) + ";\r\n";
 		dkimHeader += "\tb=";
 
-		EVP_MD_CTX* evpmdhead2 = EVP_MD_CTX_new();
-		EVP_MD_CTX_copy(evpmdhead2, evpmdhead.get());
-		std::string tmp2 = canonicalhead.FilterHeader(dkimHeader);
-		EVP_DigestUpdate(evpmdhead2, tmp2.c_str(), tmp2.size());
+		EVP_MD_CTX* evpmdhead2 = m_evpSign.get();
+		EVP_MD_CTX_copy_ex(evpmdhead2, evpmdhead);
+		canonicalhead.WriteHeader(dkimHeader, EVPDigest { evpmdhead2 });
 		EVP_DigestFinal_ex(evpmdhead2, md, &md_len);
-		EVP_MD_CTX_free(evpmdhead2);
 		/*
 		std::string tmp2 = canonicalhead.FilterHeader(dkimHeader);
-		EVP_DigestUpdate(evpmdhead.get(), tmp2.c_str(), tmp2.size());
-		EVP_DigestFinal_ex(evpmdhead.get(), md, &md_len);
+		EVP_DigestUpdate(evpmdhead, tmp2.c_str(), tmp2.size());
+		EVP_DigestFinal_ex(evpmdhead, md, &md_len);
 		*/
 
 		std::string tmp3;
@@ -263,5 +394,13 @@ std::string Signatory::CreateSignature(const SignatoryOptions& options)
 			dkimHeaders.append("\r\n");
 		dkimHeaders += dkimHeader;
 	}
+
+	// the header is to be prepended to the message as it is stored
+	if (msg.GetLineEnding() == DKIM::DKIM_LE_LF)
+	{
+		std::string::size_type crlf = 0;
+		while ((crlf = dkimHeaders.find("\r\n", crlf)) != std::string::npos)
+			dkimHeaders.erase(crlf, 1);
+	}
 	return dkimHeaders;
 }
@@ -24,10 +24,13 @@
 #include "Exception.hpp"
 #include "DKIM.hpp"
 #include "MailParser.hpp"
+#include "MessageSource.hpp"
 #include "Base64.hpp"
 #include "SignatoryOptions.hpp"
 
 #include <string>
+#include <memory>
+#include <functional>
 
 #include <openssl/evp.h>
 #include <openssl/pem.h>
@@ -38,13 +41,40 @@ namespace DKIM
 	class Signatory
 	{
 		public:
-			Signatory(std::istream& file);
+			/*
+			 * The limits are set on the source created for the message (see
+			 * Limits); a MessageSource of the caller keeps its own
+			 */
+			Signatory(std::istream& file, const Limits& limits = Limits());
+			Signatory(const char* data, size_t size, const Limits& limits = Limits());
+			Signatory(int fd, const Limits& limits = Limits());
+			Signatory(const struct iovec* iov, size_t iovcnt, const Limits& limits = Limits());
+			Signatory(const MessageSource::ChunkReader& chunks, const Limits& limits = Limits());
+			Signatory(MessageSource& source);
 			~Signatory();
 
+			void Reset(std::istream& file, const Limits& limits = Limits());
+			void Reset(const char* data, size_t size, const Limits& limits = Limits());
+			void Reset(int fd, const Limits& limits = Limits());
+			void Reset(const struct iovec* iov, size_t iovcnt, const Limits& limits = Limits());
+			void Reset(const MessageSource::ChunkReader& chunks, const Limits& limits = Limits());
+			void Reset(MessageSource& source);
+
 			std::string CreateSignature(const SignatoryOptions& options);
 		private:
-			std::istream& m_file;
-			DKIM::Message m_msg;
+			Signatory(const Signatory&);
+			Signatory& operator=(const Signatory&);
+
+			DKIM::MessageSource& OwnedSource();
+			void CreateContexts();
+
+			std::unique_ptr<DKIM::MessageSource> m_ownedSource;
+			DKIM::MessageSource* m_source;
+
+			typedef std::unique_ptr<EVP_MD_CTX, std::function<void(EVP_MD_CTX*)>> EVPContext;
+			EVPContext m_evpBody;
+			EVPContext m_evpHead;
+			EVPContext m_evpSign;
 	};
 }
 
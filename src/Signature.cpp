@@ -19,6 +19,7 @@
  *
  */
 #include "Signature.hpp"
+#include "TagName.hpp"
 #include "Tokenizer.hpp"
 #include "QuotedPrintable.hpp"
 #include "Base64.hpp"
@@ -33,6 +34,7 @@
 
 using DKIM::Signature;
 using DKIM::Conversion::Base64_Decode;
+using DKIM::Conversion::Base64_DecodedSize;
 using DKIM::Conversion::QuotedPrintable;
 using DKIM::Util::StringFormat;
 
@@ -46,8 +48,10 @@ void Signature::Reset()
 	m_signatureAlgorithm = DKIM_SA_RSA;
 	// tag-b
 	m_b = "";
+	m_decodedB = false;
 	// tag-bh
 	m_bh = "";
+	m_decodedBH = false;
 	// tag-c
 	m_header = DKIM_C_SIMPLE;
 	m_body = DKIM_C_SIMPLE;
@@ -55,6 +59,7 @@ void Signature::Reset()
 	m_domain = "";
 	// tag-h
 	m_headers.clear();
+	m_decodedH = false;
 	// tag-i
 	m_mailLocalPart = "";
 	m_mailDomain = "";
@@ -69,13 +74,11 @@ void Signature::Reset()
 	m_arcInstance = 0;
 }
 
-void Signature::Parse(const std::shared_ptr<DKIM::Header> header)
+void Signature::Parse(const DKIM::Header& header, const Limits& limits)
 {
-	m_tagList.Parse(header->GetHeader().substr(header->GetValueOffset()));
+	m_tagList.Parse(header.GetHeader().substr(header.GetValueOffset()));
 
-	std::string headerName = header->GetName();
-	transform(headerName.begin(), headerName.end(), headerName.begin(), tolower);
-	if (headerName == "arc-message-signature")
+	if (header.IsName(DKIM::HeaderName::ARC_MESSAGE_SIGNATURE))
 		m_arc = true;
 
 	/**
@@ -83,120 +86,135 @@ void Signature::Parse(const std::shared_ptr<DKIM::Header> header)
 	 */
 
 	// Domain of the signing entity
-	TagListEntry d;
-	if (!m_tagList.GetTag("d", d))
+	const TagListEntry* d = m_tagList.GetTag(DKIM::TagName::D);
+	if (!d)
 		throw DKIM::PermanentError("Missing domain of the signing entity (d)");
-	m_domain = d.GetValue();
+	m_domain = d->GetValue();
 	transform(m_domain.begin(), m_domain.end(), m_domain.begin(), tolower);
 
 	// Version
 	if (!m_arc)
 	{
-		TagListEntry v;
-		if (!m_tagList.GetTag("v", v))
+		const TagListEntry* v = m_tagList.GetTag(DKIM::TagName::V);
+		if (!v)
 			throw DKIM::PermanentError("Missing version (v)");
 
-		if (v.GetValue() != "1")
+		if (DKIM::TagValue::Lookup(v->GetValue()) != DKIM::TagValue::VERSION_1)
 			throw DKIM::PermanentError(StringFormat("Unsupported version %s (v supports 1)",
-						v.GetValue().c_str()
+						std::string(v->GetValue()).c_str()
 						)
 					);
 	}
 
 	// Algorithm
-	TagListEntry a;
-	if (!m_tagList.GetTag("a", a))
+	const TagListEntry* a = m_tagList.GetTag(DKIM::TagName::A);
+	if (!a)
 		throw DKIM::PermanentError("Missing algorithm (a)");
 
-	if (a.GetValue() == "rsa-sha256")
+	switch (DKIM::TagValue::Lookup(a->GetValue()))
 	{
-		m_digestAlgorithm = DKIM_A_SHA256;
-		m_signatureAlgorithm = DKIM_SA_RSA;
-	}
-	else if (a.GetValue() == "rsa-sha1")
-	{
-		m_digestAlgorithm = DKIM_A_SHA1;
-		m_signatureAlgorithm = DKIM_SA_RSA;
-	}
-	else if (a.GetValue() == "ed25519-sha256")
-	{
-		m_digestAlgorithm = DKIM_A_SHA256;
-		m_signatureAlgorithm = DKIM_SA_ED25519;
+		case DKIM::TagValue::RSA_SHA256:
+			m_digestAlgorithm = DKIM_A_SHA256;
+			m_signatureAlgorithm = DKIM_SA_RSA;
+			break;
+		case DKIM::TagValue::RSA_SHA1:
+			m_digestAlgorithm = DKIM_A_SHA1;
+			m_signatureAlgorithm = DKIM_SA_RSA;
+			break;
+		case DKIM::TagValue::ED25519_SHA256:
+			m_digestAlgorithm = DKIM_A_SHA256;
+			m_signatureAlgorithm = DKIM_SA_ED25519;
+			break;
+		default:
+			throw DKIM::PermanentError(StringFormat("Unsupported signature algorithm %s (a supports rsa-sha1, rsa-sha256 and ed25519-sha256)",
+						std::string(a->GetValue()).c_str()
+						)
+					);
 	}
-	else
-		throw DKIM::PermanentError(StringFormat("Unsupported signature algorithm %s (a supports rsa-sha1, rsa-sha256 and ed25519-sha256)",
-					a.GetValue().c_str()
-					)
-				);
 
-	// Signature data
-	TagListEntry b;
-	if (!m_tagList.GetTag("b", b) || b.GetValue().empty())
+	// Signature data (decoded by GetSignatureData)
+	const TagListEntry* b = m_tagList.GetTag(DKIM::TagName::B);
+	if (!b || b->GetValue().empty())
 		throw DKIM::PermanentError("Missing header signature (b)");
 
-	std::string btmp = b.GetValue();
-	btmp.erase(remove_if(btmp.begin(), btmp.end(), isspace), btmp.end());
-	m_b = Base64_Decode(btmp);
-
-	// Hash of the canonicalized body
-	TagListEntry bh;
-	if (!m_tagList.GetTag("bh", bh))
+	// Hash of the canonicalized body (decoded by GetBodyHash)
+	if (!m_tagList.GetTag(DKIM::TagName::BH))
 			throw DKIM::PermanentError("Missing body hash (bh)");
-	std::string bhtmp = bh.GetValue();
-	bhtmp.erase(remove_if(bhtmp.begin(), bhtmp.end(), isspace), bhtmp.end());
-	m_bh = Base64_Decode(bhtmp);
 
 	// Message canonicalization
-	TagListEntry c;
-	if (m_tagList.GetTag("c", c))
+	const TagListEntry* c = m_tagList.GetTag(DKIM::TagName::C);
+	if (c)
 	{
-		std::string body, header;
+		std::string_view body, header;
 
-		size_t split = c.GetValue().find('/');
+		size_t split = c->GetValue().find('/');
 		if (split == std::string::npos)
 		{
-			header = c.GetValue();
+			header = c->GetValue();
 			body = "simple";
 		} else {
-			header = c.GetValue().substr(0, split);
-			body = c.GetValue().substr(split + 1);
+			header = c->GetValue().substr(0, split);
+			body = c->GetValue().substr(split + 1);
 		}
 
-		if (header == "relaxed")
-			m_header = DKIM_C_RELAXED;
-		else if (header == "simple")
-			m_header = DKIM_C_SIMPLE;
-		else
-			throw DKIM::PermanentError(StringFormat("Unsupported canonicalization type %s (c supports simple, relaxed)",
-						header.c_str()
-						)
-					);
+		switch (DKIM::TagValue::Lookup(header))
+		{
+			case DKIM::TagValue::RELAXED:
+				m_header = DKIM_C_RELAXED;
+				break;
+			case DKIM::TagValue::SIMPLE:
+				m_header = DKIM_C_SIMPLE;
+				break;
+			default:
+				throw DKIM::PermanentError(StringFormat("Unsupported canonicalization type %s (c supports simple, relaxed)",
+							std::string(header).c_str()
+							)
+						);
+		}
 
-		if (body == "relaxed")
-			m_body = DKIM_C_RELAXED;
-		else if (body == "simple")
-			m_body = DKIM_C_SIMPLE;
-		else
-			throw DKIM::PermanentError(StringFormat("Unsupported canonicalization type %s (c supports simple, relaxed)",
-						body.c_str()
-						)
-					);
+		switch (DKIM::TagValue::Lookup(body))
+		{
+			case DKIM::TagValue::RELAXED:
+				m_body = DKIM_C_RELAXED;
+				break;
+			case DKIM::TagValue::SIMPLE:
+				m_body = DKIM_C_SIMPLE;
+				break;
+			default:
+				throw DKIM::PermanentError(StringFormat("Unsupported canonicalization type %s (c supports simple, relaxed)",
+							std::string(body).c_str()
+							)
+						);
+		}
 	}
 
-	// Signed header fields
-	TagListEntry h;
-	if (!m_tagList.GetTag("h", h))
+	// Signed header fields (decoded by GetSignedHeaders), the limit and
+	// the From: header are checked on the raw value so that no list is built
+	const TagListEntry* h = m_tagList.GetTag(DKIM::TagName::H);
+	if (!h)
 		throw DKIM::PermanentError("Missing signed header fields (h)");
-	m_headers = DKIM::Tokenizer::ValueList(h.GetValue());
+	std::string_view names = h->GetValue();
+	size_t headers = std::count(names.begin(), names.end(), ':') + 1;
+	if (limits.GetMaxSignedHeaders() && headers > limits.GetMaxSignedHeaders())
+		throw DKIM::LimitError(StringFormat("Too many signed header fields; exceeds %zu (h)",
+					limits.GetMaxSignedHeaders()
+					)
+				);
 
 	bool signedFrom = false;
-	for (std::list<std::string>::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i)
+	for (size_t start = 0; start <= names.size() && !signedFrom;)
 	{
-		if (strcasecmp(i->c_str(), "from") == 0)
+		size_t split = names.find(':', start);
+		if (split == std::string_view::npos)
+			split = names.size();
+		std::string_view name = names.substr(start, split - start);
+		size_t first = name.find_first_not_of(" \t\r\n");
+		if (first != std::string_view::npos)
 		{
-			signedFrom = true;
-			break;
+			name = name.substr(first, name.find_last_not_of(" \t\r\n") - first + 1);
+			signedFrom = DKIM::HeaderName::Lookup(name) == DKIM::HeaderName::FROM;
 		}
+		start = split + 1;
 	}
 	if (!signedFrom)
 		throw DKIM::PermanentError("From: header must be included in signature");
@@ -204,22 +222,22 @@ void Signature::Parse(const std::shared_ptr<DKIM::Header> header)
 	// Identity of the user or agent
 	if (m_arc)
 	{
-		TagListEntry i;
-		if (!m_tagList.GetTag("i", i))
+		const TagListEntry* i = m_tagList.GetTag(DKIM::TagName::I);
+		if (!i)
 			throw DKIM::PermanentError("Missing ARC instance (i)");
-		m_arcInstance = strtoul(i.GetValue().c_str(), nullptr, 10);
+		m_arcInstance = strtoul(std::string(i->GetValue()).c_str(), nullptr, 10);
 		if (m_arcInstance < 1 || m_arcInstance > 50)
 			throw DKIM::PermanentError("ARC instance (i) out of range 1-50");
 	}
 	else
 	{
-		TagListEntry i;
-		if (!m_tagList.GetTag("i", i))
+		const TagListEntry* i = m_tagList.GetTag(DKIM::TagName::I);
+		if (!i)
 		{
 			m_mailLocalPart = "";
 			m_mailDomain = m_domain;
 		} else {
-			std::string mail = QuotedPrintable::Decode(i.GetValue());
+			std::string mail = QuotedPrintable::Decode(std::string(i->GetValue()));
 
 			size_t mailsep = mail.find('@');
 			if (mailsep == std::string::npos)
@@ -246,14 +264,15 @@ void Signature::Parse(const std::shared_ptr<DKIM::Header> header)
 	}
 
 	// Body length count
-	TagListEntry l;
-	if (m_tagList.GetTag("l", l))
+	const TagListEntry* l = m_tagList.GetTag(DKIM::TagName::L);
+	if (l)
 	{
-		if (l.GetValue().size() > 76)
+		if (l->GetValue().size() > 76)
 			throw DKIM::PermanentError("Invalid body signed length; exceeds 76 digits (l)");
 
+		std::string length(l->GetValue());
 		char* ptr;
-		unsigned long bs = strtoul(l.GetValue().c_str(), &ptr, 10);
+		unsigned long bs = strtoul(length.c_str(), &ptr, 10);
 		if (errno == ERANGE)
 			throw DKIM::PermanentError("Invalid body signed length; exceeds available storage size of unsigned long (l)");
 		if ((signed long)bs < 0)
@@ -265,36 +284,77 @@ void Signature::Parse(const std::shared_ptr<DKIM::Header> header)
 	}
 
 	// Query methods
-	TagListEntry q;
-	if (m_tagList.GetTag("q", q))
+	const TagListEntry* q = m_tagList.GetTag(DKIM::TagName::Q);
+	if (q)
 	{
-		if (q.GetValue() == "dns/txt")
+		if (DKIM::TagValue::Lookup(q->GetValue()) == DKIM::TagValue::DNS_TXT)
 			m_queryType = DKIM_Q_DNSTXT;
 		else
 			throw DKIM::PermanentError(StringFormat("Unsupported query method %s (q supports dns/txt)",
-						q.GetValue().c_str()
+						std::string(q->GetValue()).c_str()
 						)
 					);
 	}
 
 	// Selector
-	TagListEntry s;
-	if (!m_tagList.GetTag("s", s))
+	const TagListEntry* s = m_tagList.GetTag(DKIM::TagName::S);
+	if (!s)
 		throw DKIM::PermanentError("Missing query selector (s)");
-	m_selector = s.GetValue();
+	m_selector = s->GetValue();
 
 	// Signature Timestamp
-	TagListEntry t;
-	if (m_tagList.GetTag("t", t))
+	if (m_tagList.GetTag(DKIM::TagName::T))
 		; // ignored
 
 	// Signature Expiration
-	TagListEntry x;
-	if (m_tagList.GetTag("x", x))
+	const TagListEntry* x = m_tagList.GetTag(DKIM::TagName::X);
+	if (x)
 	{
-		if (strtol(x.GetValue().c_str(), nullptr, 10) < time(nullptr))
+		if (strtol(std::string(x->GetValue()).c_str(), nullptr, 10) < time(nullptr))
 			throw DKIM::PermanentError("Signature has expired (x)");
 	}
 
 	return;
 }
+
+const std::pmr::string& Signature::GetSignatureData() const
+{
+	if (!m_decodedB)
+	{
+		const TagListEntry* b = m_tagList.GetTag(DKIM::TagName::B);
+		if (b)
+		{
+			m_b.resize(Base64_DecodedSize(b->GetValue().size()));
+			m_b.resize(Base64_Decode(b->GetValue(), &m_b[0]));
+		}
+		m_decodedB = true;
+	}
+	return m_b;
+}
+
+const std::pmr::string& Signature::GetBodyHash() const
+{
+	if (!m_decodedBH)
+	{
+		const TagListEntry* bh = m_tagList.GetTag(DKIM::TagName::BH);
+		if (bh)
+		{
+			m_bh.resize(Base64_DecodedSize(bh->GetValue().size()));
+			m_bh.resize(Base64_Decode(bh->GetValue(), &m_bh[0]));
+		}
+		m_decodedBH = true;
+	}
+	return m_bh;
+}
+
+const std::pmr::vector<std::string_view>& Signature::GetSignedHeaders() const
+{
+	if (!m_decodedH)
+	{
+		const TagListEntry* h = m_tagList.GetTag(DKIM::TagName::H);
+		if (h)
+			m_headers = DKIM::Tokenizer::ValueList(h->GetValue(), m_headers.get_allocator().resource());
+		m_decodedH = true;
+	}
+	return m_headers;
+}
@@ -27,6 +27,8 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <memory_resource>
 #include <stdexcept>
 #include <memory.h>
 
@@ -37,14 +39,30 @@ namespace DKIM
 		public:
 			typedef enum { DKIM_Q_DNSTXT } QueryType;
 
-			Signature()
-			: m_bodySize(0), m_bodySizeLimit(false)
+			/*
+			 * The tags and the decoded values are allocated from resource,
+			 * eg. the Arena of the message
+			 */
+			Signature(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_tagList(resource), m_b(resource), m_bh(resource), m_domain(resource), m_headers(resource)
+			, m_mailLocalPart(resource), m_mailDomain(resource), m_bodySize(0), m_bodySizeLimit(false)
+			, m_selector(resource), m_decodedB(false), m_decodedBH(false), m_decodedH(false)
 			{ Reset(); }
 
 			void Reset();
-			void Parse(const std::shared_ptr<DKIM::Header> header);
 
-			bool GetTag(const std::string& name, TagListEntry& tag) const
+			/*
+			 * Parse()
+			 *
+			 * Validate the tag syntax and the tags used for policy (v, a, c,
+			 * d, i, l, q, s, x). The h tag is checked for the From: header,
+			 * the b, bh and h tags are otherwise only checked for presence
+			 * here; they are decoded by their getters on first use, which
+			 * throw DKIM::PermanentError if the value is malformed
+			 */
+			void Parse(const DKIM::Header& header, const Limits& limits = Limits());
+
+			bool GetTag(std::string_view name, TagListEntry& tag) const
 			{ return m_tagList.GetTag(name, tag); }
 
 			const TagList& GetTagList() const
@@ -58,11 +76,8 @@ namespace DKIM
 			SignatureAlgorithm GetSignatureAlgorithm() const
 			{ return m_signatureAlgorithm; }
 
-			const std::string& GetSignatureData() const
-			{ return m_b; }
-
-			const std::string& GetBodyHash() const
-			{ return m_bh; }
+			const std::pmr::string& GetSignatureData() const;
+			const std::pmr::string& GetBodyHash() const;
 
 			CanonMode GetCanonModeHeader() const
 			{ return m_header; }
@@ -70,16 +85,18 @@ namespace DKIM
 			CanonMode GetCanonModeBody() const
 			{ return m_body; }
 
-			const std::string& GetDomain() const
+			const std::pmr::string& GetDomain() const
 			{ return m_domain; }
 
-			const std::list<std::string>& GetSignedHeaders() const
-			{ return m_headers; }
+			/*
+			 * The names are views of the tag list, as long as the signature
+			 */
+			const std::pmr::vector<std::string_view>& GetSignedHeaders() const;
 
-			const std::string& GetMailLocalPart() const
+			const std::pmr::string& GetMailLocalPart() const
 			{ return m_mailLocalPart; }
 
-			const std::string& GetMailDomain() const
+			const std::pmr::string& GetMailDomain() const
 			{ return m_mailDomain; }
 
 			unsigned long GetBodySize() const
@@ -91,7 +108,7 @@ namespace DKIM
 			QueryType GetQueryType() const
 			{ return m_queryType; }
 
-			const std::string& GetSelector() const
+			const std::pmr::string& GetSelector() const
 			{ return m_selector; }
 
 			unsigned long GetARCInstance() const
@@ -105,21 +122,26 @@ namespace DKIM
 
 			DigestAlgorithm m_digestAlgorithm;
 			SignatureAlgorithm m_signatureAlgorithm;
-			std::string m_b;
-			std::string m_bh;
+			mutable std::pmr::string m_b;
+			mutable std::pmr::string m_bh;
 			CanonMode m_header;
 			CanonMode m_body;
-			std::string m_domain;
-			std::list<std::string> m_headers;
-			std::string m_mailLocalPart;
-			std::string m_mailDomain;
+			std::pmr::string m_domain;
+			mutable std::pmr::vector<std::string_view> m_headers;
+			std::pmr::string m_mailLocalPart;
+			std::pmr::string m_mailDomain;
 			unsigned long m_bodySize;
 			bool m_bodySizeLimit;
 			QueryType m_queryType;
-			std::string m_selector;
+			std::pmr::string m_selector;
 
 			bool m_arc;
 			unsigned long m_arcInstance;
+
+			// b, bh and h are decoded lazily by the const getters
+			mutable bool m_decodedB;
+			mutable bool m_decodedBH;
+			mutable bool m_decodedH;
 	};
 }
 
@@ -19,12 +19,10 @@
  *
  */
 #include "TagList.hpp"
-#include "Tokenizer.hpp"
 #include "Util.hpp"
 #include "Exception.hpp"
 
 using DKIM::TagList;
-using DKIM::Tokenizer::ReadWhiteSpace;
 using DKIM::Util::StringFormat;
 
 /*
@@ -86,127 +84,213 @@ using DKIM::Util::StringFormat;
 
 */
 
-#include <sstream>
 #include <cstdio>
+#include <cstring>
+
+namespace {
+	enum {
+		TAG_NAME = 1,		// ALNUMPUNC, also the first character
+		TAG_VALCHAR = 2,	// %x21-3A / %x3C-7E
+		TAG_WSP = 4,		// WSP / CR / LF, skipped anywhere around tags
+	};
+
+	constexpr unsigned char Class(unsigned char c)
+	{
+		unsigned char flags = 0;
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')
+			flags |= TAG_NAME;
+		if ((c >= 0x21 && c <= 0x3A) || (c >= 0x3C && c <= 0x7E))
+			flags |= TAG_VALCHAR;
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			flags |= TAG_WSP;
+		return flags;
+	}
+
+	struct ClassTable
+	{
+		unsigned char flags[256];
+		constexpr ClassTable()
+		: flags()
+		{
+			for (int c = 0; c < 256; ++c)
+				flags[c] = Class((unsigned char)c);
+		}
+	};
+
+	constexpr ClassTable classes;
+
+	inline bool Is(const std::pmr::string& data, size_t i, unsigned char flags)
+	{
+		return i < data.size() && (classes.flags[(unsigned char)data[i]] & flags);
+	}
+}
 
 void TagList::Reset()
 {
-	m_tags.clear();
+	m_data.clear();
+	m_overflow.clear();
+	m_tags = m_inline;
+	m_count = 0;
+	std::fill(std::begin(m_known), std::end(m_known), 0);
 }
 
-void TagList::Parse(const std::string& input, bool casesensitive)
+/*
+ * Parse()
+ *
+ * Add the tags of input; the error positions are offsets in input, or -1
+ * at its end (as tellg() of a stream of it). If not casesensitive, the
+ * names are kept in lowercase.
+ */
+void TagList::Parse(std::string_view input, bool casesensitive)
 {
-	std::stringstream data(input);
+	// the views of the tags of a previous Parse() move with the data
+	const char* previous = m_data.data();
+	size_t base = m_data.size();
+	m_data.append(input);
+	if (m_data.data() != previous)
+	{
+		for (size_t t = 0; t < m_count; ++t)
+		{
+			TagListEntry& tag = m_tags[t];
+			tag.m_name = std::string_view(m_data.data() + (tag.m_name.data() - previous), tag.m_name.size());
+			tag.m_value = std::string_view(m_data.data() + (tag.m_value.data() - previous), tag.m_value.size());
+		}
+	}
+
+	auto position = [this, base] (size_t i) {
+		return i < m_data.size() ? (ssize_t)(i - base) : (ssize_t)-1;
+	};
+	auto peek = [this] (size_t i) {
+		return i < m_data.size() ? (int)(unsigned char)m_data[i] : EOF;
+	};
 
+	size_t i = base;
 	while (true)
 	{
-		std::string name;
-		std::string value;
-
 		// [ FWS ]
-		while (!ReadWhiteSpace(data, DKIM::Tokenizer::READ_WSP_LOOSE).empty());
+		while (Is(m_data, i, TAG_WSP)) ++i;
 
 		// ...
-		if (data.peek() == EOF) break;
+		if (i == m_data.size()) break;
 
 		// tag-name
-		if (
-				(data.peek() >= 'A' && data.peek() <= 'Z') ||
-				(data.peek() >= 'a' && data.peek() <= 'z') ||
-				(data.peek() >= '0' && data.peek() <= '9')
-		   ) {
-			name += (char)data.get();
-		}
-		while (
-				(data.peek() >= 'A' && data.peek() <= 'Z') ||
-				(data.peek() >= 'a' && data.peek() <= 'z') ||
-				(data.peek() >= '0' && data.peek() <= '9') ||
-				(data.peek() == '_')
-			 ) {
-			name += (char)data.get();
-		}
+		size_t nameStart = i;
+		while (Is(m_data, i, TAG_NAME)) ++i;
+		std::string_view name(m_data.data() + nameStart, i - nameStart);
 
 		if (name.empty())
 			throw DKIM::PermanentError(StringFormat("Invalid tag name (empty), expecting name at position %ld",
-						(ssize_t)data.tellg()
+						position(i)
 						)
 					);
-		if (m_tags.find(name) != m_tags.end())
-			throw DKIM::PermanentError(StringFormat("Duplicate tag name (%s)",
-							name.c_str()
+		if (Find(name))
+			throw DKIM::PermanentError(StringFormat("Duplicate tag name (%.*s)",
+							(int)name.size(), name.data()
 						)
 					);
 
 		// [ FWS ]
-		while (!ReadWhiteSpace(data, DKIM::Tokenizer::READ_WSP_LOOSE).empty());
+		while (Is(m_data, i, TAG_WSP)) ++i;
 
 		// =
-		if (data.peek() != '=')
+		if (peek(i) != '=')
 			throw DKIM::PermanentError(StringFormat("Invalid tag list; unexpected 0x%x, expecting = at position %ld",
-							data.peek() & 0xff,
-							(ssize_t)data.tellg()
+							peek(i) & 0xff,
+							position(i)
 						)
 					);
-		else
-			data.get(); // discard '='
+		++i; // discard '='
 
 		// [ FWS ]
-		while (!ReadWhiteSpace(data, DKIM::Tokenizer::READ_WSP_LOOSE).empty());
-
-		TagListEntry tagEntry;
-		tagEntry.SetValueOffset(data.tellg());
+		while (Is(m_data, i, TAG_WSP)) ++i;
 
-		// tag-value
-		std::string value_buf;
-		while (data.peek() != ';' && data.peek() != EOF)
+		// tag-value, the whitespace within it is kept but not around it
+		size_t valueOffset = i;
+		size_t valueEnd = i;
+		while (i < m_data.size() && m_data[i] != ';')
 		{
-			if (
-					(data.peek() >= '\x21' && data.peek() <= '\x3A') ||
-					(data.peek() >= '\x3C' && data.peek() <= '\x7E')
-			   ) {
-				if (!value_buf.empty())
-				{
-					value += value_buf;
-					value_buf = "";
-				}
-
-				value += (char)data.get();
-				continue;
-			}
-
-			std::string ws = ReadWhiteSpace(data, DKIM::Tokenizer::READ_WSP_LOOSE);
-			if (ws.empty())
+			if (Is(m_data, i, TAG_VALCHAR))
+				valueEnd = ++i;
+			else if (Is(m_data, i, TAG_WSP))
+				++i;
+			else
 				throw DKIM::PermanentError(StringFormat("Invalid tag value (invalid data), unexpected 0x%x at position %ld",
-							data.peek() & 0xff,
-							(ssize_t)data.tellg()
+							peek(i) & 0xff,
+							position(i)
 							)
 						);
-
-			value_buf += ws;
 		}
 
-		// save
-		tagEntry.SetValue(value);
-
 		// if case-insensitive
 		if (!casesensitive)
-			transform(name.begin(), name.end(), name.begin(), tolower);
+		{
+			char* lower = &m_data[nameStart];
+			for (size_t n = 0; n < name.size(); ++n)
+				lower[n] = (char)tolower((unsigned char)lower[n]);
+		}
 
-		m_tags[name] = tagEntry;
+		// save, a name that only differs in case replaces the previous tag
+		TagListEntry* tag = Find(name);
+		if (!tag)
+		{
+			tag = &Add();
+			TagName::Id id = TagName::Lookup(name);
+			if (id != TagName::UNKNOWN)
+				m_known[id] = m_count;
+		}
+		tag->m_name = name;
+		tag->m_value = std::string_view(m_data.data() + valueOffset, valueEnd - valueOffset);
+		tag->m_valueOffset = (std::streamoff)position(valueOffset);
 
 		// [ ';' ]
-		if (data.get() == EOF) break;
+		if (i == m_data.size()) break;
+		++i;
 	}
+}
 
-	return;
+/*
+ * GetTag()
+ *
+ * The tag of a name, or nullptr if there is none; it is valid as long as
+ * the list
+ */
+const DKIM::TagListEntry* TagList::GetTag(std::string_view name) const
+{
+	return Find(name);
 }
 
-bool TagList::GetTag(const std::string& name, TagListEntry& tag) const
+bool TagList::GetTag(std::string_view name, TagListEntry& tag) const
 {
-	std::map<std::string, TagListEntry>::const_iterator i = m_tags.find(name);
-	if (i == m_tags.end())
+	const TagListEntry* found = Find(name);
+	if (!found)
 		return false;
 
-	tag = i->second;
+	tag = *found;
 	return true;
 }
+
+DKIM::TagListEntry* TagList::Find(std::string_view name) const
+{
+	TagName::Id id = TagName::Lookup(name);
+	if (id != TagName::UNKNOWN)
+		return const_cast<TagListEntry*>(GetTag(id));
+	for (size_t t = 0; t < m_count; ++t)
+		if (m_tags[t].m_name == name)
+			return &m_tags[t];
+	return nullptr;
+}
+
+DKIM::TagListEntry& TagList::Add()
+{
+	if (m_count == InlineTags && m_tags == m_inline)
+	{
+		m_overflow.assign(m_inline, m_inline + InlineTags);
+		m_tags = m_overflow.data();
+	}
+	if (m_tags != m_inline)
+	{
+		m_overflow.emplace_back();
+		m_tags = m_overflow.data();
+	}
+	return m_tags[m_count++];
+}
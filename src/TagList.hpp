@@ -21,50 +21,87 @@
 #ifndef _DKIM_TAGLIST_HPP_
 #define _DKIM_TAGLIST_HPP_
 
+#include "TagName.hpp"
+
 #include <string>
-#include <map>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
 #include <iostream>
 #include <ctype.h>
 #include <algorithm>
 
 namespace DKIM {
+	/*
+	 * A tag of a TagList, its name and value are views of the list and
+	 * valid as long as it (until it is reset or destroyed).
+	 */
 	class TagListEntry
 	{
 		public:
-			/* Set */
-			void SetValue(const std::string& value)
-			{ m_value = value; }
-			void SetValueOffset(const std::streamoff& offset)
-			{ m_valueOffset = offset; }
+			TagListEntry()
+			: m_valueOffset(0)
+			{ }
 
 			/* Get */
-			const std::string& GetValue() const
+			std::string_view GetName() const
+			{ return m_name; }
+			std::string_view GetValue() const
 			{ return m_value; }
 			std::string GetLCaseValue() const
 			{
-				std::string value = m_value;
+				std::string value(m_value);
 				std::transform(value.begin(), value.end(), value.begin(), tolower);
 				return value;
 			}
 			std::streamoff GetValueOffset() const
 			{ return m_valueOffset; }
 		private:
-			std::string m_value;
+			friend class TagList;
+
+			std::string_view m_name;
+			std::string_view m_value;
 			std::streamoff m_valueOffset;
 	};
+	/*
+	 * A tag=value list (RFC 6376, 3.2). The input is copied once into the
+	 * memory of the list, and parsed in place; the tags are kept in order
+	 * in a flat array that is inline for up to InlineTags tags, and the
+	 * known tag names are indexed by TagName::Id while parsing.
+	 */
 	class TagList
 	{
 		public:
+			static const size_t InlineTags = 16;
+
+			TagList(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			: m_data(resource), m_overflow(resource), m_tags(m_inline), m_count(0), m_known()
+			{ }
+
 			void Reset();
 
-			void Parse(const std::string& input, bool casesensitive = true);
+			void Parse(std::string_view input, bool casesensitive = true);
 
-			bool GetTag(const std::string& name, TagListEntry& tag) const;
+			const TagListEntry* GetTag(std::string_view name) const;
+			const TagListEntry* GetTag(TagName::Id id) const
+			{ return m_known[id] ? &m_tags[m_known[id] - 1] : nullptr; }
+			bool GetTag(std::string_view name, TagListEntry& tag) const;
 
-			std::map<std::string, TagListEntry>::const_iterator cbegin() const { return m_tags.cbegin(); }
-			std::map<std::string, TagListEntry>::const_iterator cend() const { return m_tags.cend(); }
+			const TagListEntry* cbegin() const { return m_tags; }
+			const TagListEntry* cend() const { return m_tags + m_count; }
 		private:
-			std::map<std::string, TagListEntry> m_tags;
+			TagList(const TagList&);
+			TagList& operator=(const TagList&);
+
+			TagListEntry* Find(std::string_view name) const;
+			TagListEntry& Add();
+
+			std::pmr::string m_data;
+			TagListEntry m_inline[InlineTags];
+			std::pmr::vector<TagListEntry> m_overflow;
+			TagListEntry* m_tags;
+			size_t m_count;
+			size_t m_known[TagName::COUNT];
 	};
 }
 
@@ -0,0 +1,103 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "TagName.hpp"
+#include "PerfectHash.hpp"
+
+namespace {
+	// in the order of TagName::Id
+	constexpr std::string_view names[] = {
+		"",
+		"a",
+		"b",
+		"bh",
+		"c",
+		"cv",
+		"d",
+		"g",
+		"h",
+		"i",
+		"k",
+		"l",
+		"n",
+		"p",
+		"q",
+		"s",
+		"t",
+		"v",
+		"x",
+		"z",
+	};
+	static_assert(sizeof names / sizeof *names == DKIM::TagName::COUNT, "a name for each Id");
+
+	// in the order of TagValue::Id
+	constexpr std::string_view values[] = {
+		"",
+		"rsa-sha256",
+		"rsa-sha1",
+		"ed25519-sha256",
+		"simple",
+		"relaxed",
+		"dns/txt",
+		"1",
+		"DKIM1",
+		"rsa",
+		"ed25519",
+		"sha1",
+		"sha256",
+		"email",
+		"*",
+	};
+	static_assert(sizeof values / sizeof *values == DKIM::TagValue::COUNT, "a value for each Id");
+
+	constexpr DKIM::PerfectHash<DKIM::TagName::COUNT, 64, false> nameHash(names);
+	constexpr DKIM::PerfectHash<DKIM::TagValue::COUNT, 64, false> valueHash(values);
+}
+
+/*
+ * Lookup()
+ *
+ * The Id of a tag name, by a perfect hash that is computed at compile
+ * time; UNKNOWN if it is not a tag that is used
+ */
+DKIM::TagName::Id DKIM::TagName::Lookup(std::string_view name)
+{
+	return (Id)nameHash.Lookup(name);
+}
+
+std::string_view DKIM::TagName::Name(Id id)
+{
+	return nameHash.Name(id);
+}
+
+/*
+ * Lookup()
+ *
+ * The Id of an enumerated tag value; UNKNOWN if it is not one
+ */
+DKIM::TagValue::Id DKIM::TagValue::Lookup(std::string_view value)
+{
+	return (Id)valueHash.Lookup(value);
+}
+
+std::string_view DKIM::TagValue::Name(Id id)
+{
+	return valueHash.Name(id);
+}
@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (C) 2009-2014 Halon Security <support@halon.se>
+ *
+ * This file is part of libdkim++.
+ *
+ * libdkim++ is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libdkim++ is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libdkim++.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _DKIM_TAGNAME_HPP_
+#define _DKIM_TAGNAME_HPP_
+
+#include <string_view>
+
+namespace DKIM {
+	namespace TagName {
+		/*
+		 * The tag names of signatures (RFC 6376, 3.5), key records (3.6.1)
+		 * and ARC sets (RFC 8617), so that the tags of a TagList are found
+		 * by index; tag names are case-sensitive
+		 */
+		typedef enum {
+			UNKNOWN,
+			A,
+			B,
+			BH,
+			C,
+			CV,
+			D,
+			G,
+			H,
+			I,
+			K,
+			L,
+			N,
+			P,
+			Q,
+			S,
+			T,
+			V,
+			X,
+			Z,
+			COUNT
+		} Id;
+
+		Id Lookup(std::string_view name);
+		std::string_view Name(Id id);
+	}
+
+	namespace TagValue {
+		/*
+		 * The enumerated values of the a, c, q and v tags of signatures,
+		 * and of the v, h, k and s tags of key records, so that they are
+		 * compared as numbers; values are case-sensitive
+		 */
+		typedef enum {
+			UNKNOWN,
+			RSA_SHA256,
+			RSA_SHA1,
+			ED25519_SHA256,
+			SIMPLE,
+			RELAXED,
+			DNS_TXT,
+			VERSION_1,
+			DKIM1,
+			RSA,
+			ED25519,
+			SHA1,
+			SHA256,
+			EMAIL,
+			ANY,
+			COUNT
+		} Id;
+
+		Id Lookup(std::string_view value);
+		std::string_view Name(Id id);
+	}
+}
+
+#endif
@@ -89,35 +89,70 @@ std::string DKIM::Tokenizer::ReadWhiteSpace(std::istream& stream, WhiteSpaceType
 			}
 			break;
 			/**
-			 * Skip any number of WSP followed by CRLF and more than one WSP
+			 * Skip FWS ([*WSP CRLF] 1*WSP), the longest one at the position
+			 *
+			 * A state machine that reads each character once; if the line
+			 * is not folded the WSP and CRLF are put back, and there is no
+			 * FWS. Callers that take the input as data when there is no FWS
+			 * should consume the whole WSP run at once, to stay linear.
 			 */
 		case READ_FWS:
 			{
 				std::string _s;
-				std::string _t;
-
-				while (!(_t = ReadWhiteSpace(stream, READ_WSP)).empty())
-				{ _s += _t; }
-
-				if ((_t = ReadWhiteSpace(stream, READ_CRLF)).empty())
-					return _s;
-				_s += _t;
-
-				if ((_t = ReadWhiteSpace(stream, READ_WSP)).empty())
-					goto unwind;
-				_s += _t;
-
-				while (!(_t = ReadWhiteSpace(stream, READ_WSP)).empty())
-				{ _s += _t; }
-
-				return _s;
-unwind:
-				stream.clear();
-				for (size_t i = _s.size(); i > 0; i--)
+				enum { FWS_WSP, FWS_CR, FWS_LF, FWS_FOLDED } state = FWS_WSP;
+				while (true)
 				{
-					stream.putback(_s[i-1]);
+					int peek = stream.peek();
+					switch (state)
+					{
+						case FWS_WSP:
+							if (peek == ' ' || peek == '\t')
+							{
+								_s += (char)stream.get();
+								continue;
+							}
+							if (peek != '\r')
+								return _s;
+							stream.get();
+							state = FWS_CR;
+							continue;
+						case FWS_CR:
+							if (peek != '\n')
+							{
+								if (peek != EOF)
+									throw DKIM::PermanentError(StringFormat("CR without matching LF, 0x%x at position %ld",
+												peek & 0xff,
+												(ssize_t)stream.tellg()
+												)
+											);
+								else
+									throw DKIM::PermanentError("CR without matching LF, at the END");
+							}
+							stream.get();
+							state = FWS_LF;
+							continue;
+						case FWS_LF:
+							if (peek != ' ' && peek != '\t')
+							{
+								// not folded, the WSP before it is data
+								stream.clear();
+								stream.putback('\n');
+								stream.putback('\r');
+								for (size_t i = _s.size(); i > 0; i--)
+									stream.putback(_s[i-1]);
+								return "";
+							}
+							_s += "\r\n";
+							_s += (char)stream.get();
+							state = FWS_FOLDED;
+							continue;
+						case FWS_FOLDED:
+							if (peek != ' ' && peek != '\t')
+								return _s;
+							_s += (char)stream.get();
+							continue;
+					}
 				}
-				return "";
 			}
 			break;
 	}
@@ -126,54 +161,86 @@ unwind:
 	return "";
 }
 
-std::list<std::string> DKIM::Tokenizer::ValueList(const std::string& input)
-{
-	std::list<std::string> values;
+namespace {
+	/*
+	 * SkipFWS()
+	 *
+	 * The end of the FWS at offset i of data (i if there is none); as
+	 * READ_FWS, the WSP before a CRLF that is not folded is not FWS, and
+	 * a run of folded lines is skipped at once
+	 */
+	size_t SkipFWS(std::string_view data, size_t i)
+	{
+		size_t wsp = i;
+		while (true)
+		{
+			while (wsp < data.size() && (data[wsp] == ' ' || data[wsp] == '\t'))
+				++wsp;
+			if (wsp == data.size() || data[wsp] != '\r')
+				return wsp;
+
+			if (wsp + 1 == data.size())
+				throw DKIM::PermanentError("CR without matching LF, at the END");
+			if (data[wsp + 1] != '\n')
+				throw DKIM::PermanentError(StringFormat("CR without matching LF, 0x%x at position %ld",
+							data[wsp + 1] & 0xff,
+							(ssize_t)(wsp + 1)
+							)
+						);
+
+			wsp += 2;
+			if (wsp == data.size() || (data[wsp] != ' ' && data[wsp] != '\t'))
+				return i;
+			while (wsp < data.size() && (data[wsp] == ' ' || data[wsp] == '\t'))
+				++wsp;
+			i = wsp;
+		}
+	}
+}
 
-	std::stringstream data(input);
+std::pmr::vector<std::string_view> DKIM::Tokenizer::ValueList(std::string_view input, std::pmr::memory_resource* resource)
+{
+	std::pmr::vector<std::string_view> values(resource);
 
+	size_t i = 0;
 	while (true)
 	{
-		std::string value;
-
 		// [ FWS ]
-		while (!ReadWhiteSpace(data, READ_FWS).empty());
+		i = SkipFWS(input, i);
 
 		// ...
-		if (data.peek() == EOF) break;
+		if (i == input.size()) break;
 
-		// tag-value
-		std::string value_buf;
-		while (true)
+		// tag-value, the FWS within it is kept but not around it
+		size_t start = i;
+		size_t end = i;
+		while (i < input.size() && input[i] != ':')
 		{
-			std::string ws = ReadWhiteSpace(data, READ_FWS);
-			if (ws.empty())
+			size_t ws = SkipFWS(input, i);
+			if (ws != i)
+				i = ws;
+			else if (input[i] == ' ' || input[i] == '\t')
 			{
-				if (data.peek() == ':' || data.peek() == EOF)
-					break;
-
-				if (!value_buf.empty())
-				{
-					value += value_buf;
-					value_buf = "";
-				}
-
-				value += (char)data.get();
+				// WSP before a CRLF that is not folded, the run is data
+				while (i < input.size() && (input[i] == ' ' || input[i] == '\t'))
+					++i;
+				end = i;
 			}
-
-			value_buf += ws;
+			else
+				end = ++i;
 		}
 
-		if (value.empty())
+		if (end == start)
 			throw DKIM::PermanentError(StringFormat("Invalid list value (empty), expecting value at position %ld",
-						(ssize_t)data.tellg()
+						(ssize_t)i
 						)
 					);
 
-		values.push_back(value);
+		values.push_back(input.substr(start, end - start));
 
 		// [ ':' ]
-		if (data.get() == EOF) break;
+		if (i == input.size()) break;
+		++i;
 	}
 
 	return values;
@@ -266,6 +333,13 @@ DKIM::Tokenizer::AddressListTokens DKIM::Tokenizer::NextAddressListToken(std::st
 			data.get();
 			return TOK_SEPARATOR;
 		}
+		if (data.peek() == ' ' || data.peek() == '\t')
+		{
+			// WSP before a CRLF that is not folded, the run is data
+			while (data.peek() == ' ' || data.peek() == '\t')
+				token += (char)data.get();
+			continue;
+		}
 		token += (char)data.get();
 	}
 
@@ -22,7 +22,10 @@
 #define _DKIM_TOKENIZER_HPP_
 
 #include <string>
+#include <string_view>
 #include <list>
+#include <vector>
+#include <memory_resource>
 #include <iostream>
 #include <sstream>
 
@@ -37,7 +40,12 @@ namespace DKIM {
 
 		std::string ReadWhiteSpace(std::istream& stream, WhiteSpaceType type);
 
-		std::list<std::string> ValueList(const std::string& input);
+		/*
+		 * The values of a colon separated list (eg. the h tag), as views
+		 * of input without the FWS around them
+		 */
+		std::pmr::vector<std::string_view> ValueList(std::string_view input,
+				std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
 		typedef enum {
 			TOK_QUOTED,
@@ -32,7 +32,7 @@ using DKIM::Validatory;
 #include "Exception.hpp"
 
 using DKIM::Conversion::CanonicalizationHeader;
-using DKIM::Conversion::CanonicalizationBody;
+using DKIM::Conversion::EVPDigest;
 using DKIM::Util::StringFormat;
 using DKIM::TagList;
 using DKIM::TagListEntry;
@@ -43,44 +43,165 @@ using DKIM::TagListEntry;
 
 //#define DEBUG
 
-Validatory::Validatory(std::istream& stream, ValidatorType type)
+Validatory::Validatory(std::istream& stream, ValidatorType type, const Limits& limits)
 : CustomDNSData(nullptr)
-, m_file(stream)
+, m_ownedSource(new DKIM::MessageSource(stream))
+, m_source(m_ownedSource.get())
+, m_msg(nullptr)
 {
-	while (m_msg.ParseLine(m_file) && !m_msg.IsDone()) { }
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+Validatory::Validatory(const char* data, size_t size, ValidatorType type, const Limits& limits)
+: CustomDNSData(nullptr)
+, m_ownedSource(new DKIM::MessageSource(data, size))
+, m_source(m_ownedSource.get())
+, m_msg(nullptr)
+{
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+Validatory::Validatory(int fd, ValidatorType type, const Limits& limits)
+: CustomDNSData(nullptr)
+, m_ownedSource(new DKIM::MessageSource(fd))
+, m_source(m_ownedSource.get())
+, m_msg(nullptr)
+{
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+Validatory::Validatory(const struct iovec* iov, size_t iovcnt, ValidatorType type, const Limits& limits)
+: CustomDNSData(nullptr)
+, m_ownedSource(new DKIM::MessageSource(iov, iovcnt))
+, m_source(m_ownedSource.get())
+, m_msg(nullptr)
+{
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+Validatory::Validatory(const MessageSource::ChunkReader& chunks, ValidatorType type, const Limits& limits)
+: CustomDNSData(nullptr)
+, m_ownedSource(new DKIM::MessageSource(chunks))
+, m_source(m_ownedSource.get())
+, m_msg(nullptr)
+{
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+Validatory::Validatory(MessageSource& source, ValidatorType type)
+: CustomDNSData(nullptr)
+, m_source(&source)
+, m_msg(nullptr)
+{
+	ParseMessage(type);
+}
+
+Validatory::~Validatory()
+{
+}
+
+/*
+ * Reset()
+ *
+ * Validate another message, as if the validator was constructed for it;
+ * the custom resolver is kept. The buffers, digest contexts and the
+ * source (if the validator owns one) of the previous message are reused.
+ * Signatures and PublicKeys constructed with GetResource() are to be
+ * destroyed before.
+ */
+void Validatory::Reset(std::istream& stream, ValidatorType type, const Limits& limits)
+{
+	OwnedSource().Reset(stream);
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+void Validatory::Reset(const char* data, size_t size, ValidatorType type, const Limits& limits)
+{
+	OwnedSource().Reset(data, size);
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+void Validatory::Reset(int fd, ValidatorType type, const Limits& limits)
+{
+	OwnedSource().Reset(fd);
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+void Validatory::Reset(const struct iovec* iov, size_t iovcnt, ValidatorType type, const Limits& limits)
+{
+	OwnedSource().Reset(iov, iovcnt);
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+void Validatory::Reset(const MessageSource::ChunkReader& chunks, ValidatorType type, const Limits& limits)
+{
+	OwnedSource().Reset(chunks);
+	m_ownedSource->SetLimits(limits);
+	ParseMessage(type);
+}
+
+void Validatory::Reset(MessageSource& source, ValidatorType type)
+{
+	m_source = &source;
+	ParseMessage(type);
+}
+
+DKIM::MessageSource& Validatory::OwnedSource()
+{
+	if (!m_ownedSource)
+		m_ownedSource.reset(new DKIM::MessageSource());
+	m_source = m_ownedSource.get();
+	return *m_ownedSource;
+}
+
+void Validatory::ParseMessage(ValidatorType type)
+{
+	m_dkimHeaders.clear();
+	m_bodyHash.Reset();
+
+	// the signatures are found by a scan, the header is parsed when one
+	// of them is checked
+	m_msg = &m_source->ScanHeaders();
+	m_bodyHash.SetDotStuffed(m_source->IsDotStuffed());
+	m_bodyHash.SetLineEnding(m_msg->GetLineEnding());
 
 	if (type == NONE)
 		return;
 
+	const Limits& limits = m_source->GetLimits();
 	DKIM::Message::HeaderList::const_iterator i;
-	for (i = m_msg.GetHeaders().begin(); i != m_msg.GetHeaders().end(); ++i)
+	for (i = m_msg->GetHeaders().begin(); i != m_msg->GetHeaders().end(); ++i)
 	{
-		// headers should be matched in lower-case
-		std::string headerName = (*i)->GetName();
-		transform(headerName.begin(), headerName.end(), headerName.begin(), tolower);
-
-		// collect all signatures
-		if ((type == DKIM && headerName == "dkim-signature") ||
-			(type == ARC && headerName == "arc-message-signature"))
+		// collect all signatures (names are matched in any case)
+		if ((type == DKIM && (*i)->IsName(HeaderName::DKIM_SIGNATURE)) ||
+			(type == ARC && (*i)->IsName(HeaderName::ARC_MESSAGE_SIGNATURE)))
 		{
+			// the signatures beyond the limit are not evaluated
+			if (limits.GetMaxSignatures() && m_dkimHeaders.size() == limits.GetMaxSignatures())
+				break;
 			m_dkimHeaders.push_back(*i);
 		}
 	}
 }
 
-Validatory::~Validatory()
-{
-}
-
 /*
  * GetSignature()
  *
  * Get the signature from supported header iterator
  */
-void Validatory::GetSignature(const Message::HeaderList::const_iterator& headerIter,
+void Validatory::GetSignature(const SignatureList::const_iterator& headerIter,
 		DKIM::Signature& sig)
 {
-	sig.Parse(*headerIter);
+	sig.Parse(**headerIter, m_source->GetLimits());
 	CheckBodyHash(sig);
 }
 
@@ -94,7 +215,8 @@ void Validatory::GetPublicKey(const DKIM::Signature& sig,
 {
 	if (sig.GetQueryType() == DKIM::Signature::DKIM_Q_DNSTXT)
 	{
-		std::string query = sig.GetSelector() + "._domainkey." + sig.GetDomain();
+		std::string query(sig.GetSelector());
+		query.append("._domainkey.").append(sig.GetDomain());
 		std::string publicKey;
 
 		if ((CustomDNSResolver?
@@ -108,6 +230,14 @@ void Validatory::GetPublicKey(const DKIM::Signature& sig,
 							sig.GetDomain().c_str()
 							)
 						);
+			size_t maxRecordSize = m_source->GetLimits().GetMaxRecordSize();
+			if (maxRecordSize && publicKey.size() > maxRecordSize)
+				throw DKIM::LimitError(StringFormat("Key for signature %s._domainkey.%s exceeds %zu bytes",
+							sig.GetSelector().c_str(),
+							sig.GetDomain().c_str(),
+							maxRecordSize
+							)
+						);
 			pubkey.Parse(publicKey);
 			return;
 		}
@@ -130,35 +260,38 @@ void Validatory::GetPublicKey(const DKIM::Signature& sig,
  */
 void Validatory::CheckBodyHash(const DKIM::Signature& sig)
 {
-	std::unique_ptr<EVP_MD_CTX, std::function<void(EVP_MD_CTX*)>> evpmdbody(EVP_MD_CTX_create(), [] (EVP_MD_CTX* p) { EVP_MD_CTX_destroy(p); });
-
-	// create signature for our body (message data)
-	switch (sig.GetDigestAlgorithm())
+	std::string bh;
+	if (!m_bodyHash.Get(sig.GetCanonModeBody(), sig.GetDigestAlgorithm(), sig.GetBodySizeLimit(), sig.GetBodySize(), bh))
 	{
-		case DKIM::DKIM_A_SHA1:
-			EVP_DigestInit_ex(evpmdbody.get(), EVP_sha1(), nullptr);
-			break;
-		case DKIM::DKIM_A_SHA256:
-			EVP_DigestInit_ex(evpmdbody.get(), EVP_sha256(), nullptr);
-			break;
+		/*
+		 * The body is canonicalized and hashed in one pass for all
+		 * signatures of the message (those that can be parsed), the
+		 * following lookups are served from the table.
+		 */
+		m_bodyHash.Add(sig.GetCanonModeBody(), sig.GetDigestAlgorithm(), sig.GetBodySizeLimit(), sig.GetBodySize());
+		if (m_dkimHeaders.size() > 1)
+		{
+			for (const auto & header : m_dkimHeaders)
+			{
+				DKIM::Signature other(m_source->GetResource());
+				try {
+					other.Parse(*header, m_source->GetLimits());
+				} catch (DKIM::PermanentError&) {
+					continue;
+				}
+				m_bodyHash.Add(other.GetCanonModeBody(), other.GetDigestAlgorithm(), other.GetBodySizeLimit(), other.GetBodySize());
+			}
+		}
+		m_bodyHash.SetPipelined(m_source->UsePipeline(m_msg->GetBodyOffset()));
+		m_source->ReadBody(m_msg->GetBodyOffset(), [this] (const char* data, size_t size) {
+			m_bodyHash.Update(data, size);
+			return !m_bodyHash.IsDone();
+		});
+		m_bodyHash.Final();
+		m_bodyHash.Get(sig.GetCanonModeBody(), sig.GetDigestAlgorithm(), sig.GetBodySizeLimit(), sig.GetBodySize(), bh);
 	}
 
-	DKIM::Conversion::EVPDigest evpupd;
-	evpupd.ctx = evpmdbody.get();
-
-	CanonicalizationBody(m_file,
-			sig.GetCanonModeBody(),
-			m_msg.GetBodyOffset(),
-			sig.GetBodySizeLimit(),
-			sig.GetBodySize(),
-			std::bind(&DKIM::Conversion::EVPDigest::update, &evpupd, std::placeholders::_1, std::placeholders::_2));
-
-	unsigned char md_value[EVP_MAX_MD_SIZE];
-	unsigned int md_len;
-	EVP_DigestFinal_ex(evpmdbody.get(), md_value, &md_len);
-
-	if (sig.GetBodyHash().size() != md_len ||
-			memcmp(sig.GetBodyHash().c_str(), md_value, md_len) != 0)
+	if (std::string_view(sig.GetBodyHash()) != bh)
 	{
 		throw DKIM::PermanentError("Body hash did not verify", AR_FAIL);
 	}
@@ -169,7 +302,7 @@ void Validatory::CheckBodyHash(const DKIM::Signature& sig)
  *
  * Validate the message according to rfc6376
  */
-void Validatory::CheckSignature(const std::shared_ptr<DKIM::Header> header,
+void Validatory::CheckSignature(const DKIM::Header* header,
 		const DKIM::Signature& sig,
 		const DKIM::PublicKey& pub)
 {
@@ -205,51 +338,37 @@ void Validatory::CheckSignature(const std::shared_ptr<DKIM::Header> header,
 
 	CanonicalizationHeader canonicalhead(sig.GetCanonModeHeader());
 
-	// add all headers to our cache (they will be pop of the end)
-	std::map<std::string, Message::HeaderList> headerCache;
-	for (const auto & hIter : m_msg.GetHeaders())
+	// add all signed headers to our hash (each name is taken from the bottom up)
+	Message::HeaderCursor cursor(m_source->ParseHeaders());
+	for (const auto & name : sig.GetSignedHeaders())
 	{
-		std::string headerName = hIter->GetName();
-		transform(headerName.begin(), headerName.end(), headerName.begin(), tolower);
-		headerCache[headerName].push_back(hIter);
-	}
-
-	// add all signed headers to our hash
-	for (auto name : sig.GetSignedHeaders())
-	{
-		std::string tmp;
-		transform(name.begin(), name.end(), name.begin(), tolower);
-
-		std::map<std::string, Message::HeaderList>::iterator head = headerCache.find(name);
+		const DKIM::Header* head = cursor.Next(name);
 
 		// if this occurred
 		// 1. we do not have a header of that name at all
 		// 2. all headers with that name has been included...
-		if (head == headerCache.end() || head->second.size() == 0)
+		if (!head)
 			continue;
 
 #ifdef DEBUG
-		printf("[%s]\n", canonicalhead.FilterHeader(head->second.back()->GetHeader()).c_str());
+		printf("[%s]\n", canonicalhead.FilterHeader(head->GetHeader()).c_str());
 		printf("[CRLF]\n");
 #endif
-		tmp = canonicalhead.FilterHeader(head->second.back()->GetHeader()) + "\r\n";
-		head->second.pop_back();
-		EVP_DigestUpdate(evpmdhead.get(), tmp.c_str(), tmp.size());
+		canonicalhead.WriteHeader(*head, EVPDigest { evpmdhead.get() }, true);
 	}
 
 	// add our dkim-signature to the calculation (remove the "b"-tag)
-	std::string h = header->GetHeader().substr(0, header->GetValueOffset());
-	std::string v = header->GetHeader().substr(header->GetValueOffset());
+	std::string h(header->GetHeader().substr(0, header->GetValueOffset()));
+	std::string v(header->GetHeader().substr(header->GetValueOffset()));
 
-	DKIM::TagListEntry bTag;
-	sig.GetTag("b", bTag);
-	v.erase((int)bTag.GetValueOffset(), bTag.GetValue().size());
+	const DKIM::TagListEntry* bTag = sig.GetTagList().GetTag(DKIM::TagName::B);
+	if (bTag)
+		v.erase((size_t)bTag->GetValueOffset(), bTag->GetValue().size());
 
-	std::string tmp = canonicalhead.FilterHeader(h + v);
 #ifdef DEBUG
-	printf("[%s]\n", tmp.c_str());
+	printf("[%s]\n", canonicalhead.FilterHeader(h + v).c_str());
 #endif
-	EVP_DigestUpdate(evpmdhead.get(), tmp.c_str(), tmp.size());
+	canonicalhead.WriteHeader(h + v, EVPDigest { evpmdhead.get() });
 
 	unsigned char md[EVP_MAX_MD_SIZE];
 	unsigned int md_len;
@@ -25,11 +25,15 @@
 #include "PublicKey.hpp"
 #include "Signature.hpp"
 #include "MailParser.hpp"
+#include "MessageSource.hpp"
+#include "BodyHash.hpp"
 
 #include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/err.h>
 #include <functional>
+#include <memory>
+#include <vector>
 
 namespace DKIM
 {
@@ -37,26 +41,42 @@ namespace DKIM
 	{
 		public:
 			typedef enum { DKIM, ARC, NONE } ValidatorType;
-			typedef std::shared_ptr<DKIM::Header> SignatureItem;
-			typedef std::list<SignatureItem> SignatureList;
+			typedef const DKIM::Header* SignatureItem;
+			typedef std::vector<SignatureItem> SignatureList;
 
-			Validatory(std::istream& file, ValidatorType type = DKIM);
+			/*
+			 * The limits are set on the source created for the message (see
+			 * Limits); a MessageSource of the caller keeps its own
+			 */
+			Validatory(std::istream& file, ValidatorType type = DKIM, const Limits& limits = Limits());
+			Validatory(const char* data, size_t size, ValidatorType type = DKIM, const Limits& limits = Limits());
+			Validatory(int fd, ValidatorType type = DKIM, const Limits& limits = Limits());
+			Validatory(const struct iovec* iov, size_t iovcnt, ValidatorType type = DKIM, const Limits& limits = Limits());
+			Validatory(const MessageSource::ChunkReader& chunks, ValidatorType type = DKIM, const Limits& limits = Limits());
+			Validatory(MessageSource& source, ValidatorType type = DKIM);
 			~Validatory();
 
-			void GetSignature(const Message::HeaderList::const_iterator& headerIter, DKIM::Signature& sig);
+			void Reset(std::istream& file, ValidatorType type = DKIM, const Limits& limits = Limits());
+			void Reset(const char* data, size_t size, ValidatorType type = DKIM, const Limits& limits = Limits());
+			void Reset(int fd, ValidatorType type = DKIM, const Limits& limits = Limits());
+			void Reset(const struct iovec* iov, size_t iovcnt, ValidatorType type = DKIM, const Limits& limits = Limits());
+			void Reset(const MessageSource::ChunkReader& chunks, ValidatorType type = DKIM, const Limits& limits = Limits());
+			void Reset(MessageSource& source, ValidatorType type = DKIM);
+
+			void GetSignature(const SignatureList::const_iterator& headerIter, DKIM::Signature& sig);
 
 			void CheckBodyHash(const DKIM::Signature& sig);
 
 			void GetPublicKey(const DKIM::Signature& sig, DKIM::PublicKey& pub);
 
-			void CheckSignature(const Message::HeaderList::const_iterator& headerIter,
+			void CheckSignature(const SignatureList::const_iterator& headerIter,
 					const DKIM::Signature& sig,
 					const DKIM::PublicKey& pub)
 			{
 				CheckSignature(*headerIter, sig, pub);
 			}
 
-			void CheckSignature(const std::shared_ptr<DKIM::Header> header,
+			void CheckSignature(const DKIM::Header* header,
 					const DKIM::Signature& sig,
 					const DKIM::PublicKey& pub);
 
@@ -65,11 +85,28 @@ namespace DKIM
 				return m_dkimHeaders;
 			}
 
+			/*
+			 * The arena of the message source; Signatures and PublicKeys
+			 * constructed with it are freed with the source
+			 */
+			std::pmr::memory_resource* GetResource() const
+			{
+				return m_source->GetResource();
+			}
+
 			std::function<bool(const std::string&, std::string&, void*)> CustomDNSResolver;
 			void *CustomDNSData;
 		private:
-			std::istream& m_file;
-			DKIM::Message m_msg;
+			Validatory(const Validatory&);
+			Validatory& operator=(const Validatory&);
+
+			DKIM::MessageSource& OwnedSource();
+			void ParseMessage(ValidatorType type);
+
+			std::unique_ptr<DKIM::MessageSource> m_ownedSource;
+			DKIM::MessageSource* m_source;
+			const DKIM::Message* m_msg;
+			DKIM::Conversion::BodyHash m_bodyHash;
 
 			SignatureList m_dkimHeaders;
 	};
@@ -1,5 +1,7 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <src/Base64.hpp>
+#include <openssl/evp.h>
+#include <stdexcept>
 
 using DKIM::Conversion::Base64_Encode;
 using DKIM::Conversion::Base64_Decode;
@@ -7,6 +9,9 @@ using DKIM::Conversion::Base64_Decode;
 class Base64Test : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( Base64Test );
 	CPPUNIT_TEST( ConversionTest );
+	CPPUNIT_TEST( WhiteSpaceTest );
+	CPPUNIT_TEST( InvalidTest );
+	CPPUNIT_TEST( BlockTest );
 	CPPUNIT_TEST_SUITE_END();
 	public:
 	void setUp() { }
@@ -21,6 +26,60 @@ class Base64Test : public CppUnit::TestFixture {
 		CPPUNIT_ASSERT ( Base64_Decode(Base64_Encode("")) == "" );
 		CPPUNIT_ASSERT ( Base64_Decode(Base64_Encode("\x12\x22")) == "\x12\x22" );
 	}
+	void WhiteSpaceTest()
+	{
+		// as in the FWS of a tag value, anywhere
+		CPPUNIT_ASSERT ( Base64_Decode("SGVs\r\n\tbG8=") == "Hello" );
+		CPPUNIT_ASSERT ( Base64_Decode(" S G V s b G 8 = ") == "Hello" );
+		CPPUNIT_ASSERT ( Base64_Decode("SGVsbA=\r\n =") == "Hell" );
+		CPPUNIT_ASSERT ( Base64_Decode(" \r\n ") == "" );
+
+		// only FWS is skipped; VT and FF (isspace) are invalid
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVs\vbG8="), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVs\fbG8="), std::runtime_error );
+
+		// into a buffer
+		std::string e = "SGVq\r\n IQ==";
+		char out[DKIM::Conversion::Base64_DecodedSize(12)];
+		CPPUNIT_ASSERT ( DKIM::Conversion::Base64_Decode(e, out) == 4 );
+		CPPUNIT_ASSERT ( std::string(out, 4) == "Hej!" );
+		char enc[DKIM::Conversion::Base64_EncodedSize(4)];
+		CPPUNIT_ASSERT ( DKIM::Conversion::Base64_Encode("Hej!", enc) == 8 );
+		CPPUNIT_ASSERT ( std::string(enc, 8) == "SGVqIQ==" );
+	}
+	void InvalidTest()
+	{
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVq!Q=="), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVqIQ"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVqI"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVqIQ="), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVqIQ=A"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVqIQ==SGVq"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("=SGVq"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("S==="), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( Base64_Decode("SGVq\x80Q=="), std::runtime_error );
+
+		// the position of the first invalid character
+		std::string error;
+		try { Base64_Decode("SGVq\r\n I;=="); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid base64 data, unexpected 0x3b at position 8" );
+		try { Base64_Decode("SGVqIQ"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid base64 data (truncated), at the END" );
+	}
+	void BlockTest()
+	{
+		// the same as the EVP block functions of OpenSSL, at every length around a quantum
+		std::string data;
+		for (size_t size = 0; size < 300; ++size)
+		{
+			std::string encoded = Base64_Encode(data);
+			std::string expected(DKIM::Conversion::Base64_EncodedSize(size) + 1, '\0');
+			expected.resize((size_t)EVP_EncodeBlock((unsigned char*)&expected[0], (const unsigned char*)data.c_str(), (int)size));
+			CPPUNIT_ASSERT ( encoded == expected );
+			CPPUNIT_ASSERT ( Base64_Decode(encoded) == data );
+			data += (char)(size * 131 + 7);
+		}
+	}
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( Base64Test );
@@ -0,0 +1,153 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <src/BodyHash.hpp>
+#include <src/Canonicalization.hpp>
+#include <sstream>
+
+using DKIM::Conversion::BodyHash;
+using DKIM::Conversion::CanonicalizationBody;
+
+std::string BodyHashSingle(std::istream& stream, DKIM::CanonMode type, DKIM::DigestAlgorithm algorithm, bool bodyLimit, size_t bodySize)
+{
+	EVP_MD_CTX* ctx = EVP_MD_CTX_create();
+	EVP_DigestInit_ex(ctx, algorithm == DKIM::DKIM_A_SHA1 ? EVP_sha1() : EVP_sha256(), nullptr);
+	DKIM::Conversion::EVPDigest evpupd;
+	evpupd.ctx = ctx;
+	CanonicalizationBody(stream, type, 0, bodyLimit, bodySize, std::bind(&DKIM::Conversion::EVPDigest::update, &evpupd, std::placeholders::_1, std::placeholders::_2));
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	EVP_DigestFinal_ex(ctx, md, &md_len);
+	EVP_MD_CTX_destroy(ctx);
+	return std::string((const char*)md, md_len);
+}
+
+class BodyHashTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( BodyHashTest );
+	CPPUNIT_TEST( MultiHashTest );
+	CPPUNIT_TEST( PipelinedTest );
+	CPPUNIT_TEST_SUITE_END();
+	public:
+	void setUp() { }
+	void tearDown() { }
+	void MultiHashTest()
+	{
+		const char* bodies[] = { "", "\r\n\r\n", "Hello  World \r\n\r\n\tfoo\r\n\r\n" };
+		const DKIM::CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+		const DKIM::DigestAlgorithm algorithms[] = { DKIM::DKIM_A_SHA1, DKIM::DKIM_A_SHA256 };
+		const size_t limits[] = { 0, 1, 5, 14, 1000 };
+
+		for (auto body : bodies)
+		{
+			std::stringstream data(body);
+			BodyHash bodyHash;
+			for (auto type : types)
+				for (auto algorithm : algorithms)
+				{
+					bodyHash.Add(type, algorithm, false, 0);
+					for (auto limit : limits)
+						bodyHash.Add(type, algorithm, true, limit);
+				}
+			bodyHash.Run(data, 0);
+
+			for (auto type : types)
+				for (auto algorithm : algorithms)
+				{
+					std::string hash;
+					std::stringstream single(body);
+					CPPUNIT_ASSERT ( bodyHash.Get(type, algorithm, false, 0, hash) );
+					CPPUNIT_ASSERT ( hash == BodyHashSingle(single, type, algorithm, false, 0) );
+					for (auto limit : limits)
+					{
+						std::stringstream single(body);
+						CPPUNIT_ASSERT ( bodyHash.Get(type, algorithm, true, limit, hash) );
+						CPPUNIT_ASSERT ( hash == BodyHashSingle(single, type, algorithm, true, limit) );
+					}
+				}
+		}
+
+		/*
+		 * pushing the body in chunks
+		 */
+
+		std::string body = bodies[2];
+		for (size_t chunk = 1; chunk <= body.size(); ++chunk)
+		{
+			BodyHash bodyHash;
+			for (auto type : types)
+			{
+				bodyHash.Add(type, DKIM::DKIM_A_SHA256, false, 0);
+				bodyHash.Add(type, DKIM::DKIM_A_SHA256, true, 5);
+			}
+			for (size_t i = 0; i < body.size(); i += chunk)
+				bodyHash.Update(body.c_str() + i, std::min(chunk, body.size() - i));
+			bodyHash.Final();
+
+			for (auto type : types)
+			{
+				std::string hash;
+				std::stringstream single(body);
+				CPPUNIT_ASSERT ( bodyHash.Get(type, DKIM::DKIM_A_SHA256, false, 0, hash) );
+				CPPUNIT_ASSERT ( hash == BodyHashSingle(single, type, DKIM::DKIM_A_SHA256, false, 0) );
+				std::stringstream single2(body);
+				CPPUNIT_ASSERT ( bodyHash.Get(type, DKIM::DKIM_A_SHA256, true, 5, hash) );
+				CPPUNIT_ASSERT ( hash == BodyHashSingle(single2, type, DKIM::DKIM_A_SHA256, true, 5) );
+			}
+		}
+
+		BodyHash bodyHash;
+		std::string hash;
+		CPPUNIT_ASSERT ( !bodyHash.Get(DKIM::DKIM_C_SIMPLE, DKIM::DKIM_A_SHA256, false, 0, hash) );
+		bodyHash.Add(DKIM::DKIM_C_SIMPLE, DKIM::DKIM_A_SHA256, false, 0);
+		CPPUNIT_ASSERT ( !bodyHash.Get(DKIM::DKIM_C_SIMPLE, DKIM::DKIM_A_SHA256, false, 0, hash) );
+	}
+	void PipelinedTest()
+	{
+		/*
+		 * hashing in threads gives the same hashes
+		 */
+
+		std::string body;
+		for (size_t i = 0; body.size() < 1024 * 1024; ++i)
+			body += std::string(i % 97, 'x') + (i % 5 ? " \t " : "") + "\r\n" + (i % 7 ? "" : "\r\n");
+
+		const DKIM::CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+		const DKIM::DigestAlgorithm algorithms[] = { DKIM::DKIM_A_SHA1, DKIM::DKIM_A_SHA256 };
+		const size_t limits[] = { 0, 65536, 300000, 2000000 };
+
+		BodyHash bodyHash;
+		BodyHash pipelined;
+		pipelined.SetPipelined(true);
+		for (auto type : types)
+			for (auto algorithm : algorithms)
+			{
+				bodyHash.Add(type, algorithm, false, 0);
+				pipelined.Add(type, algorithm, false, 0);
+				for (auto limit : limits)
+				{
+					bodyHash.Add(type, algorithm, true, limit);
+					pipelined.Add(type, algorithm, true, limit);
+				}
+			}
+		std::stringstream data(body);
+		bodyHash.Run(data, 0);
+		std::stringstream data2(body);
+		pipelined.Run(data2, 0);
+
+		for (auto type : types)
+			for (auto algorithm : algorithms)
+			{
+				std::string hash, hash2;
+				CPPUNIT_ASSERT ( bodyHash.Get(type, algorithm, false, 0, hash) );
+				CPPUNIT_ASSERT ( pipelined.Get(type, algorithm, false, 0, hash2) );
+				CPPUNIT_ASSERT ( hash == hash2 );
+				for (auto limit : limits)
+				{
+					CPPUNIT_ASSERT ( bodyHash.Get(type, algorithm, true, limit, hash) );
+					CPPUNIT_ASSERT ( pipelined.Get(type, algorithm, true, limit, hash2) );
+					CPPUNIT_ASSERT ( hash == hash2 );
+				}
+			}
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( BodyHashTest );
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION( BodyHashTest, "BodyHashTest" );
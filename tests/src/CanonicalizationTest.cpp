@@ -1,8 +1,11 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <src/Canonicalization.hpp>
+#include <src/Exception.hpp>
+#include <cstring>
 
 using DKIM::Conversion::CanonicalizationHeader;
 using DKIM::Conversion::CanonicalizationBody;
+using DKIM::Conversion::BodyCanonicalizer;
 
 struct StringTest
 {
@@ -21,12 +24,53 @@ std::string CanonicalizationBodyTest(std::string input, DKIM::CanonMode type)
 	return foo.str;
 }
 
+/*
+ * Byte-at-a-time body canonicalization, used as a reference for the
+ * vectorized implementation
+ */
+std::string CanonicalizationBodyReference(const std::string& input, DKIM::CanonMode type)
+{
+	std::string buf;
+	bool pendingwsp = false;
+	size_t lines = 0;
+	for (size_t i = 0; i < input.size(); ++i)
+	{
+		if (input[i] == '\r')
+			continue;
+		if (input[i] == '\n')
+		{
+			pendingwsp = false;
+			++lines;
+			continue;
+		}
+		if (type == DKIM::DKIM_C_RELAXED && (input[i] == ' ' || input[i] == '\t'))
+		{
+			pendingwsp = true;
+			continue;
+		}
+		for (; lines > 0; --lines)
+			buf += "\r\n";
+		if (pendingwsp)
+			buf += ' ';
+		pendingwsp = false;
+		buf += input[i];
+	}
+	if (!buf.empty() || type != DKIM::DKIM_C_RELAXED)
+		buf += "\r\n";
+	return buf;
+}
+
 class CanonicalizationTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( CanonicalizationTest );
 	CPPUNIT_TEST( TestHeaderSimple );
 	CPPUNIT_TEST( TestHeaderRelaxed );
+	CPPUNIT_TEST( TestHeaderWrite );
 	CPPUNIT_TEST( TestBodySimple );
 	CPPUNIT_TEST( TestBodyRelaxed );
+	CPPUNIT_TEST( TestBodyLong );
+	CPPUNIT_TEST( TestBodyChunked );
+	CPPUNIT_TEST( TestBodyDotStuffed );
+	CPPUNIT_TEST( TestBodyLineEnding );
 	CPPUNIT_TEST_SUITE_END();
 	public:
 	void setUp() { }
@@ -82,6 +126,40 @@ class CanonicalizationTest : public CppUnit::TestFixture {
 				);
 
 	}
+	void TestHeaderWrite()
+	{
+		/*
+		 * the streamed form is the filtered header followed by CRLF, also
+		 * for the corner cases of the colon and unfolding rules
+		 */
+		const char* headers[] = {
+			"SUBJect: AbC",
+			"SUBJect \t:\t AbC  ",
+			"  : AbC",
+			"Subject:  \t",
+			"Subject: a \r\nb",
+			"Subject: a\r\n",
+			"Subject:\r\n \r\n\tAbC \r\n ",
+			"To: a,\r\n  b,\r\n\tc",
+		};
+		StringTest foo;
+		for (auto mode : { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED })
+		{
+			CanonicalizationHeader canonicalhead(mode);
+			for (auto header : headers)
+			{
+				foo.str.clear();
+				canonicalhead.WriteHeader(header, std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2), true);
+				CPPUNIT_ASSERT_EQUAL(canonicalhead.FilterHeader(header) + "\r\n", foo.str);
+			}
+		}
+
+		CanonicalizationHeader canonicalhead(DKIM::DKIM_C_RELAXED);
+		CPPUNIT_ASSERT_EQUAL(std::string(" :AbC"), canonicalhead.FilterHeader("  : AbC"));
+		CPPUNIT_ASSERT_EQUAL(std::string("subject:a \r\nb"), canonicalhead.FilterHeader("Subject: a \r\nb"));
+		CPPUNIT_ASSERT_THROW(canonicalhead.FilterHeader("Subject AbC"), DKIM::PermanentError);
+		CPPUNIT_ASSERT_THROW(canonicalhead.FilterHeader("Subject: A\rbC"), DKIM::PermanentError);
+	}
 	void TestBodySimple()
 	{
 		/*
@@ -121,6 +199,157 @@ class CanonicalizationTest : public CppUnit::TestFixture {
 					"Hello\r\n\r\n\r\n World !\r\n\r\n\r\n\r\nHello\r\nHello\r\n Hello\r\n Hello World\r\n"
 				);
 	}
+	void TestBodyLong()
+	{
+		/*
+		 * runs of every length around the vector widths, with whitespace,
+		 * bare CR/LF and multi-buffer bodies
+		 */
+
+		std::string input;
+		const char* pattern = "abc \t  def\t\r\n  \r\n\nxyz\r \r\n\r\n";
+		for (size_t i = 0; i < 200; ++i)
+		{
+			input += std::string(i, (char)('a' + i % 26));
+			input += pattern + (i % strlen(pattern));
+		}
+		while (input.size() < 3 * 8096)
+			input += input;
+
+		CPPUNIT_ASSERT (
+					CanonicalizationBodyTest(input, DKIM::DKIM_C_SIMPLE) ==
+					CanonicalizationBodyReference(input, DKIM::DKIM_C_SIMPLE)
+				);
+		CPPUNIT_ASSERT (
+					CanonicalizationBodyTest(input, DKIM::DKIM_C_RELAXED) ==
+					CanonicalizationBodyReference(input, DKIM::DKIM_C_RELAXED)
+				);
+
+		input = std::string(100, ' ') + "\r\n" + std::string(100, '\t') + "x" + std::string(100, '\n');
+		CPPUNIT_ASSERT (
+					CanonicalizationBodyTest(input, DKIM::DKIM_C_SIMPLE) ==
+					CanonicalizationBodyReference(input, DKIM::DKIM_C_SIMPLE)
+				);
+		CPPUNIT_ASSERT (
+					CanonicalizationBodyTest(input, DKIM::DKIM_C_RELAXED) ==
+					CanonicalizationBodyReference(input, DKIM::DKIM_C_RELAXED)
+				);
+	}
+	void TestBodyChunked()
+	{
+		/*
+		 * chunks splitting CRLF and whitespace runs should give the same
+		 * result as reading the body at once
+		 */
+
+		std::string input = "Hello \t \r\n\r\n\tWorld\t\t!\r\n \r\n\r\nHello  \t\r\n\r\n";
+		const DKIM::CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+		for (auto type : types)
+		{
+			for (size_t chunk = 1; chunk <= input.size(); ++chunk)
+			{
+				StringTest foo;
+				auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+				BodyCanonicalizer canonicalbody(type, false, 0, sink);
+				for (size_t i = 0; i < input.size(); i += chunk)
+					canonicalbody.Update(input.c_str() + i, std::min(chunk, input.size() - i));
+				CPPUNIT_ASSERT ( canonicalbody.Final() );
+				CPPUNIT_ASSERT ( foo.str == CanonicalizationBodyTest(input, type) );
+			}
+
+			StringTest foo;
+			auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+			BodyCanonicalizer canonicalbody(type, true, 10, sink);
+			for (size_t i = 0; i < input.size(); ++i)
+				canonicalbody.Update(input.c_str() + i, 1);
+			CPPUNIT_ASSERT ( canonicalbody.IsDone() );
+			CPPUNIT_ASSERT ( canonicalbody.Final() );
+			CPPUNIT_ASSERT ( foo.str == CanonicalizationBodyTest(input, type).substr(0, 10) );
+		}
+	}
+	void TestBodyDotStuffed()
+	{
+		/*
+		 * dot-stuffed data is unstuffed in the same pass, and ends at the
+		 * "." line; anything after it is ignored
+		 */
+
+		std::string input = "..Hello\r\n..\r\n\r\n. World \r\n.\rx\r\n...\r\n";
+		std::string unstuffed = ".Hello\r\n.\r\n\r\n World \r\n\rx\r\n..\r\n";
+		const std::string terminators[] = { "", ".\r\nTrailing\r\n", ".\nTrailing" };
+		const DKIM::CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+		for (auto type : types)
+		{
+			for (const auto & terminator : terminators)
+			{
+				std::string data = input + terminator;
+				for (size_t chunk = 1; chunk <= data.size(); ++chunk)
+				{
+					StringTest foo;
+					auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+					BodyCanonicalizer canonicalbody(type, false, 0, sink, true);
+					for (size_t i = 0; i < data.size(); i += chunk)
+						canonicalbody.Update(data.c_str() + i, std::min(chunk, data.size() - i));
+					CPPUNIT_ASSERT ( canonicalbody.IsDone() == !terminator.empty() );
+					CPPUNIT_ASSERT ( canonicalbody.Final() );
+					CPPUNIT_ASSERT ( foo.str == CanonicalizationBodyTest(unstuffed, type) );
+				}
+			}
+		}
+	}
+	void TestBodyLineEnding()
+	{
+		/*
+		 * with LF line endings a CR is data, LF ends a line
+		 */
+
+		std::string input = "a\r\nb \r\nc \t\n\r\n\n\n";
+		const struct { DKIM::CanonMode type; const char* output; } tests[] = {
+			{ DKIM::DKIM_C_SIMPLE, "a\r\r\nb \r\r\nc \t\r\n\r\r\n" },
+			{ DKIM::DKIM_C_RELAXED, "a\r\r\nb \r\r\nc\r\n\r\r\n" },
+		};
+		for (const auto & test : tests)
+		{
+			for (size_t chunk = 1; chunk <= input.size(); ++chunk)
+			{
+				StringTest foo;
+				auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+				BodyCanonicalizer canonicalbody(test.type, false, 0, sink, false, DKIM::DKIM_LE_LF);
+				for (size_t i = 0; i < input.size(); i += chunk)
+					canonicalbody.Update(input.c_str() + i, std::min(chunk, input.size() - i));
+				CPPUNIT_ASSERT ( canonicalbody.Final() );
+				CPPUNIT_ASSERT ( foo.str == test.output );
+			}
+		}
+
+		// and a CR after the period of a dot-stuffed line is kept
+		std::string plain = "a\n\rX\n.b\n\r\n";
+		std::string stuffed = "a\n.\rX\n..b\n.\r\n.\n";
+		for (const auto & test : tests)
+		{
+			std::string expected;
+			{
+				StringTest foo;
+				auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+				BodyCanonicalizer canonicalbody(test.type, false, 0, sink, false, DKIM::DKIM_LE_LF);
+				canonicalbody.Update(plain.c_str(), plain.size());
+				CPPUNIT_ASSERT ( canonicalbody.Final() );
+				expected = foo.str;
+			}
+			CPPUNIT_ASSERT ( expected.find("\r\n\rX\r\n") != std::string::npos );
+			for (size_t chunk = 1; chunk <= stuffed.size(); ++chunk)
+			{
+				StringTest foo;
+				auto sink = std::bind(&StringTest::update, &foo, std::placeholders::_1, std::placeholders::_2);
+				BodyCanonicalizer canonicalbody(test.type, false, 0, sink, true, DKIM::DKIM_LE_LF);
+				for (size_t i = 0; i < stuffed.size(); i += chunk)
+					canonicalbody.Update(stuffed.c_str() + i, std::min(chunk, stuffed.size() - i));
+				CPPUNIT_ASSERT ( canonicalbody.IsDone() );
+				CPPUNIT_ASSERT ( canonicalbody.Final() );
+				CPPUNIT_ASSERT ( foo.str == expected );
+			}
+		}
+	}
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( CanonicalizationTest );
@@ -0,0 +1,53 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <src/HeaderName.hpp>
+#include <src/MailParser.hpp>
+
+namespace HeaderName = DKIM::HeaderName;
+
+class HeaderNameTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( HeaderNameTest );
+	CPPUNIT_TEST( LookupTest );
+	CPPUNIT_TEST( MessageTest );
+	CPPUNIT_TEST_SUITE_END();
+	public:
+	void setUp() { }
+	void tearDown() { }
+	void LookupTest()
+	{
+		for (int i = 1; i < HeaderName::COUNT; ++i)
+			CPPUNIT_ASSERT ( HeaderName::Lookup(HeaderName::Name((HeaderName::Id)i)) == i );
+
+		CPPUNIT_ASSERT ( HeaderName::Lookup("DKIM-Signature") == HeaderName::DKIM_SIGNATURE );
+		CPPUNIT_ASSERT ( HeaderName::Lookup("LIST-unsubscribe-Post") == HeaderName::LIST_UNSUBSCRIBE_POST );
+		CPPUNIT_ASSERT ( HeaderName::Name(HeaderName::FROM) == "from" );
+		CPPUNIT_ASSERT ( HeaderName::Name(HeaderName::UNKNOWN) == "" );
+
+		CPPUNIT_ASSERT ( HeaderName::Lookup("") == HeaderName::UNKNOWN );
+		CPPUNIT_ASSERT ( HeaderName::Lookup("X-Mailer") == HeaderName::UNKNOWN );
+		CPPUNIT_ASSERT ( HeaderName::Lookup("fro") == HeaderName::UNKNOWN );
+		CPPUNIT_ASSERT ( HeaderName::Lookup("from ") == HeaderName::UNKNOWN );
+		CPPUNIT_ASSERT ( HeaderName::Lookup("list-unsubscribe-posts") == HeaderName::UNKNOWN );
+	}
+	void MessageTest()
+	{
+		std::string data = "From: a\r\nX-Mailer: b\r\n  ARC-Seal : c\r\nfrom: d\r\n\r\n";
+		DKIM::Message msg;
+		msg.Parse(data.c_str(), data.size());
+		CPPUNIT_ASSERT ( msg.GetHeaders().size() == 3 );
+		CPPUNIT_ASSERT ( msg.GetHeaders()[0]->IsName(HeaderName::FROM) );
+		CPPUNIT_ASSERT ( msg.GetHeaders()[1]->GetNameId() == HeaderName::UNKNOWN );
+		CPPUNIT_ASSERT ( msg.GetHeaders()[1]->IsName("x-mailer") );
+		CPPUNIT_ASSERT ( msg.GetHeaders()[2]->IsName(HeaderName::FROM) );
+
+		// known and unknown names are found in any case
+		CPPUNIT_ASSERT ( msg.FindHeaders("FROM")->size() == 2 );
+		CPPUNIT_ASSERT ( msg.FindHeaders("FROM")->front()->GetHeader() == "from: d" );
+		CPPUNIT_ASSERT ( msg.FindHeaders("x-MAILER")->size() == 1 );
+		CPPUNIT_ASSERT ( msg.FindHeaders("x-MAILER")->front()->GetHeader() == "X-Mailer: b\r\n  ARC-Seal : c" );
+		CPPUNIT_ASSERT ( msg.FindHeaders("arc-seal") == nullptr );
+		CPPUNIT_ASSERT ( msg.FindHeaders("x-other") == nullptr );
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( HeaderNameTest );
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION( HeaderNameTest, "HeaderNameTest" );
@@ -1,13 +1,24 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <src/MailParser.hpp>
+#include <src/Exception.hpp>
 #include <iostream>
 #include <sstream>
+#include <cstring>
 
 using DKIM::Message;
 
 class MailParserTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( MailParserTest );
 	CPPUNIT_TEST( ParserTest );
+	CPPUNIT_TEST( BufferTest );
+	CPPUNIT_TEST( DotStuffedTest );
+	CPPUNIT_TEST( LineEndingTest );
+	CPPUNIT_TEST( CanonicalTest );
+	CPPUNIT_TEST( IndexTest );
+	CPPUNIT_TEST( ViewTest );
+	CPPUNIT_TEST( ArenaTest );
+	CPPUNIT_TEST( LimitTest );
+	CPPUNIT_TEST( ScanTest );
 	CPPUNIT_TEST_SUITE_END();
 	public:
 	void setUp() { }
@@ -86,6 +97,302 @@ class MailParserTest : public CppUnit::TestFixture {
 			CPPUNIT_ASSERT( (*i)->GetHeader() == "xxx" );
 		}
 	}
+	void BufferTest()
+	{
+		const char* mails[] = {
+			"Subject: test",
+			"Subject: test\r\n",
+			"Subject: test\r\n\r",
+			"Subject: test\r\n\r\n",
+			"Subject: test\r\n\r\nbody\r\n",
+			"Subject: test\nSubject2 : test\n\tfolded\n\nbody",
+			"Subject: test\r\nSubject2 : test\r\nSubject3 : test\r\n test\r\nxxx",
+			"test\r\n",
+			"\r\nbody",
+			"",
+		};
+		for (const char* mail : mails)
+		{
+			std::stringstream data(mail);
+			Message streamMessage;
+			while (streamMessage.ParseLine(data) && !streamMessage.IsDone()) { }
+
+			Message bufferMessage;
+			bufferMessage.Parse(mail, strlen(mail));
+			_CompareMessages(bufferMessage, streamMessage);
+
+			// any split into chunks, lines and CRLFs straddle them
+			for (size_t chunk = 1; chunk <= strlen(mail); ++chunk)
+			{
+				Message chunkMessage;
+				for (size_t i = 0; i < strlen(mail) && !chunkMessage.IsDone(); i += chunk)
+					chunkMessage.ParseChunk(mail + i, std::min(chunk, strlen(mail) - i));
+				chunkMessage.ParseEnd();
+				_CompareMessages(chunkMessage, streamMessage);
+			}
+		}
+	}
+	void DotStuffedTest()
+	{
+		Message myMessage;
+
+		{
+			const char* data = "..Subject: test\r\n.\r\nxxx: test\r\n";
+			myMessage.Reset();
+			myMessage.SetDotStuffed(true);
+			myMessage.Parse(data, strlen(data));
+			Message::HeaderList::const_iterator i = myMessage.GetHeaders().begin();
+
+			CPPUNIT_ASSERT( myMessage.GetHeaders().size() == 1 );
+			CPPUNIT_ASSERT( (*i)->GetName() == ".Subject" );
+			CPPUNIT_ASSERT( (*i)->GetHeader() == ".Subject: test" );
+
+			CPPUNIT_ASSERT( myMessage.GetBodyOffset() == -1 );
+		}
+
+		{
+			std::stringstream data("Subject: test\r\n\r\n.\r\n");
+			myMessage.Reset();
+			myMessage.SetDotStuffed(true);
+			while (myMessage.ParseLine(data) && !myMessage.IsDone()) { }
+
+			CPPUNIT_ASSERT( myMessage.GetHeaders().size() == 1 );
+			CPPUNIT_ASSERT( myMessage.GetBodyOffset() == 17 );
+		}
+	}
+	void LineEndingTest()
+	{
+		Message myMessage;
+
+		{
+			const char* data = "Subject: test\r\nX: a\n b\n\nbody";
+			myMessage.Reset();
+			myMessage.SetLineEnding(DKIM::DKIM_LE_LF);
+			myMessage.Parse(data, strlen(data));
+			Message::HeaderList::const_iterator i = myMessage.GetHeaders().begin();
+
+			CPPUNIT_ASSERT( myMessage.GetLineEnding() == DKIM::DKIM_LE_LF );
+			CPPUNIT_ASSERT( myMessage.GetHeaders().size() == 2 );
+			CPPUNIT_ASSERT( (*i)->GetHeader() == "Subject: test\r" );
+			++i;
+			CPPUNIT_ASSERT( (*i)->GetHeader() == "X: a\r\n b" );
+			CPPUNIT_ASSERT( myMessage.GetBodyOffset() == 24 );
+		}
+
+		{
+			const char* data = "Subject: test\nX: a\r\n b\n\nbody";
+			myMessage.Reset();
+			myMessage.SetLineEnding(DKIM::DKIM_LE_AUTO);
+			myMessage.Parse(data, strlen(data));
+			Message::HeaderList::const_iterator i = myMessage.GetHeaders().begin();
+
+			CPPUNIT_ASSERT( myMessage.GetLineEnding() == DKIM::DKIM_LE_LF );
+			++i;
+			CPPUNIT_ASSERT( (*i)->GetHeader() == "X: a\r\r\n b" );
+		}
+
+		{
+			const char* data = "Subject: test\r\nX: a\n b\r\n\r\nbody";
+			myMessage.Reset();
+			myMessage.SetLineEnding(DKIM::DKIM_LE_AUTO);
+			myMessage.Parse(data, strlen(data));
+			Message::HeaderList::const_iterator i = myMessage.GetHeaders().begin();
+
+			CPPUNIT_ASSERT( myMessage.GetLineEnding() == DKIM::DKIM_LE_CRLF );
+			CPPUNIT_ASSERT( (*i)->GetHeader() == "Subject: test" );
+			++i;
+			CPPUNIT_ASSERT( (*i)->GetHeader() == "X: a\r\n b" );
+		}
+	}
+	void CanonicalTest()
+	{
+		Message myMessage;
+		const char* data = "SUBJect :  test\r\n\t again \r\n\r\nbody";
+		myMessage.Parse(data, strlen(data));
+		const DKIM::Header& header = *myMessage.GetHeaders().front();
+
+		const std::pmr::string& relaxed = header.GetCanonical(DKIM::DKIM_C_RELAXED);
+		CPPUNIT_ASSERT( relaxed == "subject:test again\r\n" );
+		CPPUNIT_ASSERT( &header.GetCanonical(DKIM::DKIM_C_RELAXED) == &relaxed );
+		CPPUNIT_ASSERT( header.GetCanonical(DKIM::DKIM_C_SIMPLE) == "SUBJect :  test\r\n\t again \r\n" );
+	}
+	void IndexTest()
+	{
+		Message myMessage;
+		std::string data = "Received: 1\r\nTo: a\r\nRECEIVED: 2\r\nbroken\r\nreceived : 3\r\n";
+		for (int i = 0; i < 40; ++i)
+			data += "X-Header-" + std::to_string(i) + ": x\r\n";
+		data += "\r\nbody";
+		myMessage.Parse(data.c_str(), data.size());
+
+		const Message::HeaderList* received = myMessage.FindHeaders("Received");
+		CPPUNIT_ASSERT( received && received->size() == 3 );
+		CPPUNIT_ASSERT( (*received)[0]->GetHeader() == "received : 3" );
+		CPPUNIT_ASSERT( (*received)[2]->GetHeader() == "Received: 1" );
+		CPPUNIT_ASSERT( myMessage.FindHeaders("x-header-39") && myMessage.FindHeaders("X-HEADER-0") );
+		CPPUNIT_ASSERT( myMessage.FindHeaders("Subject") == nullptr );
+		CPPUNIT_ASSERT( myMessage.FindHeaders("")->front()->GetHeader() == "broken" );
+
+		Message::HeaderCursor cursor(myMessage);
+		CPPUNIT_ASSERT( cursor.Next("received")->GetHeader() == "received : 3" );
+		CPPUNIT_ASSERT( cursor.Next("to")->GetHeader() == "To: a" );
+		CPPUNIT_ASSERT( cursor.Next("To") == nullptr );
+		CPPUNIT_ASSERT( cursor.Next("Received")->GetHeader() == "RECEIVED: 2" );
+		CPPUNIT_ASSERT( cursor.Next("Received")->GetHeader() == "Received: 1" );
+		CPPUNIT_ASSERT( cursor.Next("Received") == nullptr );
+		CPPUNIT_ASSERT( cursor.Next("Subject") == nullptr );
+	}
+	void ViewTest()
+	{
+		Message myMessage;
+		std::string data = "Subject: test\r\n folded\r\nX: a\n b\r\n.Y: c\r\n\r\nbody";
+		auto inData = [&data] (std::string_view view) {
+			return view.data() >= data.data() && view.data() + view.size() <= data.data() + data.size();
+		};
+
+		// fields that are stored as they are refer to the buffer, others are copied
+		myMessage.Parse(data.c_str(), data.size());
+		Message::HeaderList::const_iterator i = myMessage.GetHeaders().begin();
+		CPPUNIT_ASSERT( myMessage.GetHeaders().size() == 3 );
+		CPPUNIT_ASSERT( (*i)->GetHeader() == "Subject: test\r\n folded" && inData((*i)->GetHeader()) );
+		CPPUNIT_ASSERT( (*i)->GetName() == "Subject" && inData((*i)->GetName()) );
+		++i;
+		CPPUNIT_ASSERT( (*i)->GetHeader() == "X: a\r\n b" && !inData((*i)->GetHeader()) );
+		CPPUNIT_ASSERT( (*i)->GetName() == "X" );
+		++i;
+		CPPUNIT_ASSERT( (*i)->GetHeader() == ".Y: c" && inData((*i)->GetHeader()) );
+
+		myMessage.Reset();
+		myMessage.SetDotStuffed(true);
+		myMessage.Parse(data.c_str(), data.size());
+		i = myMessage.GetHeaders().begin() + 2;
+		CPPUNIT_ASSERT( (*i)->GetHeader() == "Y: c" && inData((*i)->GetHeader()) );
+
+		std::stringstream stream(data);
+		myMessage.Reset();
+		myMessage.SetDotStuffed(false);
+		while (myMessage.ParseLine(stream) && !myMessage.IsDone()) { }
+		CPPUNIT_ASSERT( myMessage.GetHeaders().front()->GetHeader() == "Subject: test\r\n folded" );
+		CPPUNIT_ASSERT( !inData(myMessage.GetHeaders().front()->GetHeader()) );
+	}
+	void ArenaTest()
+	{
+		// counts what is allocated from it, and frees nothing until destroyed
+		struct CountingResource : std::pmr::monotonic_buffer_resource
+		{
+			size_t count = 0;
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				++count;
+				return std::pmr::monotonic_buffer_resource::do_allocate(bytes, alignment);
+			}
+		} resource;
+
+		Message myMessage(&resource);
+		std::stringstream data("Received: 1\r\nSubject: test\r\n again\r\nReceived: 2\r\n\r\nbody");
+		while (myMessage.ParseLine(data) && !myMessage.IsDone()) { }
+		CPPUNIT_ASSERT( myMessage.GetHeaders().size() == 3 );
+		CPPUNIT_ASSERT( myMessage.GetHeaders()[1]->GetHeader() == "Subject: test\r\n again" );
+		CPPUNIT_ASSERT( myMessage.GetHeaders().get_allocator().resource() == &resource );
+		CPPUNIT_ASSERT( resource.count > 0 );
+
+		size_t count = resource.count;
+		const std::pmr::string& canonical = myMessage.GetHeaders()[1]->GetCanonical(DKIM::DKIM_C_RELAXED);
+		CPPUNIT_ASSERT( canonical == "subject:test again\r\n" );
+		CPPUNIT_ASSERT( canonical.get_allocator().resource() == &resource );
+		CPPUNIT_ASSERT( resource.count > count );
+	}
+	void LimitTest()
+	{
+		std::string data = "Received: 1\r\nSubject: test\r\n again\r\nReceived: 2\r\n\r\nbody";
+
+		Message fields;
+		fields.SetLimits(DKIM::Limits().SetMaxHeaderCount(2));
+		CPPUNIT_ASSERT_THROW( fields.Parse(data.c_str(), data.size()), DKIM::LimitError );
+
+		Message bytes;
+		bytes.SetLimits(DKIM::Limits().SetMaxHeaderBytes(20));
+		CPPUNIT_ASSERT_THROW( bytes.Parse(data.c_str(), data.size()), DKIM::LimitError );
+
+		// a partial line is bounded before it is complete
+		Message chunked;
+		chunked.SetLimits(DKIM::Limits().SetMaxHeaderBytes(20));
+		std::string line = "Subject: " + std::string(30, 'x');
+		CPPUNIT_ASSERT_THROW( chunked.ParseChunk(line.c_str(), line.size()), DKIM::LimitError );
+
+		Message unlimited;
+		unlimited.SetLimits(DKIM::Limits().SetMaxHeaderCount(0).SetMaxHeaderBytes(0));
+		unlimited.Parse(data.c_str(), data.size());
+		CPPUNIT_ASSERT( unlimited.GetHeaders().size() == 3 );
+
+		Message exact;
+		exact.SetLimits(DKIM::Limits().SetMaxHeaderCount(3).SetMaxHeaderBytes(data.size() - 4));
+		exact.Parse(data.c_str(), data.size());
+		CPPUNIT_ASSERT( exact.GetHeaders().size() == 3 );
+	}
+	void ScanTest()
+	{
+		std::vector<std::string_view> names = { "dkim-signature", "arc-*" };
+		std::vector<std::pair<std::string, DKIM::LineEnding>> mails = {
+			{ "Received: 1\r\nDKIM-Signature: a\r\n\tb\r\nARC-Seal: c\r\narc: d\r\n\r\nbody\n\nbody", DKIM::DKIM_LE_CRLF },
+			{ "Received: 1\ndkim-signature : a\n b\n\nbody\r\n\r\n", DKIM::DKIM_LE_CRLF },
+			{ "Received: 1\ndkim-signature: a\n\r\n\nbody", DKIM::DKIM_LE_LF },
+			{ "DKIM-Signature: a\r\nReceived: 1\r\n\r\n", DKIM::DKIM_LE_AUTO },
+			{ "\r\nDKIM-Signature: a\r\n\r\n", DKIM::DKIM_LE_CRLF },
+			{ " DKIM-Signature: a\r\n b", DKIM::DKIM_LE_CRLF },
+			{ "", DKIM::DKIM_LE_CRLF },
+		};
+		for (const auto & mail : mails)
+		{
+			Message parsed;
+			parsed.SetLineEnding(mail.second);
+			parsed.Parse(mail.first.c_str(), mail.first.size());
+
+			Message scanned;
+			scanned.SetLineEnding(mail.second);
+			scanned.Scan(mail.first.c_str(), mail.first.size(), names);
+			CPPUNIT_ASSERT( scanned.IsDone() );
+			CPPUNIT_ASSERT( scanned.GetBodyOffset() == parsed.GetBodyOffset() );
+			CPPUNIT_ASSERT( scanned.GetLineEnding() == parsed.GetLineEnding() );
+
+			Message::HeaderList::const_iterator i = scanned.GetHeaders().begin();
+			for (const auto & header : parsed.GetHeaders())
+			{
+				if (!header->IsName("dkim-signature") && header->GetName().substr(0, 4) != "ARC-")
+					continue;
+				CPPUNIT_ASSERT( i != scanned.GetHeaders().end() );
+				CPPUNIT_ASSERT( (*i)->GetHeader() == header->GetHeader() );
+				++i;
+			}
+			CPPUNIT_ASSERT( i == scanned.GetHeaders().end() );
+		}
+
+		std::string data = "Received: 1\r\nReceived: 2\r\nReceived: 3\r\n\r\nbody";
+		Message fields;
+		fields.SetLimits(DKIM::Limits().SetMaxHeaderCount(2));
+		CPPUNIT_ASSERT_THROW( fields.Scan(data.c_str(), data.size(), names), DKIM::LimitError );
+		Message bytes;
+		bytes.SetLimits(DKIM::Limits().SetMaxHeaderBytes(data.size() - 5));
+		CPPUNIT_ASSERT_THROW( bytes.Scan(data.c_str(), data.size(), names), DKIM::LimitError );
+		Message exact;
+		exact.SetLimits(DKIM::Limits().SetMaxHeaderCount(3).SetMaxHeaderBytes(data.size() - 4));
+		exact.Scan(data.c_str(), data.size(), names);
+		CPPUNIT_ASSERT( exact.GetHeaders().empty() );
+		CPPUNIT_ASSERT( exact.GetBodyOffset() == (std::streamoff)data.size() - 4 );
+	}
+	void _CompareMessages(const Message& message, const Message& expected)
+	{
+		CPPUNIT_ASSERT( message.IsDone() );
+		CPPUNIT_ASSERT( message.GetBodyOffset() == expected.GetBodyOffset() );
+		CPPUNIT_ASSERT( message.GetHeaders().size() == expected.GetHeaders().size() );
+		Message::HeaderList::const_iterator i = expected.GetHeaders().begin();
+		for (const auto & header : message.GetHeaders())
+		{
+			CPPUNIT_ASSERT( header->GetName() == (*i)->GetName() );
+			CPPUNIT_ASSERT( header->GetHeader() == (*i)->GetHeader() );
+			++i;
+		}
+	}
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( MailParserTest );
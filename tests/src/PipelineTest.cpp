@@ -0,0 +1,52 @@
+#include <cppunit/extensions/HelperMacros.h>
+#include <src/Pipeline.hpp>
+#include <string>
+
+using DKIM::Conversion::Pipeline;
+
+class PipelineTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( PipelineTest );
+	CPPUNIT_TEST( OrderTest );
+	CPPUNIT_TEST_SUITE_END();
+	public:
+	void setUp() { }
+	void tearDown() { }
+	void OrderTest()
+	{
+		/*
+		 * every consumer gets all data in order, also when the writes
+		 * are not aligned to the buffers and the ring wraps around
+		 */
+
+		std::string input;
+		for (size_t i = 0; input.size() < 100000; ++i)
+			input += std::to_string(i) + ",";
+
+		const size_t writes[] = { 1, 7, 64, 1000 };
+		for (auto write : writes)
+		{
+			std::string output[3];
+			{
+				Pipeline pipeline(3, 64);
+				for (auto & out : output)
+				{
+					std::string* o = &out;
+					pipeline.AddConsumer([o] (const char* data, size_t size) {
+						o->append(data, size);
+					});
+				}
+				for (size_t i = 0; i < input.size(); i += write)
+					pipeline.Write(input.c_str() + i, std::min(write, input.size() - i));
+				pipeline.Close();
+			}
+			for (auto & out : output)
+				CPPUNIT_ASSERT ( out == input );
+		}
+
+		Pipeline pipeline;
+		pipeline.Close();
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( PipelineTest );
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION( PipelineTest, "PipelineTest" );
@@ -3,6 +3,9 @@
 #include <src/Validatory.hpp>
 #include <iostream>
 #include <sstream>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
 
 #include "Keys.hpp"
 
@@ -13,6 +16,13 @@ using DKIM::Validatory;
 class SignatoryTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( SignatoryTest );
 	CPPUNIT_TEST( SignTest );
+	CPPUNIT_TEST( MultiSignTest );
+	CPPUNIT_TEST( SourceTest );
+	CPPUNIT_TEST( DotStuffedTest );
+	CPPUNIT_TEST( LineEndingTest );
+	CPPUNIT_TEST( ReuseTest );
+	CPPUNIT_TEST( LimitTest );
+	CPPUNIT_TEST( LazyTest );
 	CPPUNIT_TEST_SUITE_END();
 	public:
 	void setUp() { }
@@ -39,6 +49,389 @@ class SignatoryTest : public CppUnit::TestFixture {
 			_SignMailTest(options, "From: erik@halon.se");
 		}	
 	}
+	void MultiSignTest()
+	{
+		std::string mail = "From: erik@halon.se\r\n\r\nHello  World \r\n\r\n";
+		std::string heads;
+		for (int i = 0; i < 4; ++i)
+		{
+			SignatoryOptions options;
+			options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+			options.SetCanonModeBody(i % 2 ? DKIM::DKIM_C_RELAXED : DKIM::DKIM_C_SIMPLE);
+			if (i > 1)
+				options.SetSignBodyLength(i);
+			std::stringstream fp(mail);
+			std::string head;
+			CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+			heads += head + "\r\n";
+		}
+
+		std::stringstream fp(heads + mail);
+		Validatory myValidatory(fp);
+
+		const Validatory::SignatureList& siglist = myValidatory.GetSignatures();
+		CPPUNIT_ASSERT ( siglist.size() == 4 );
+
+		DKIM::PublicKey pub;
+		CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+		for (auto i = siglist.begin(); i != siglist.end(); ++i)
+		{
+			DKIM::Signature sig;
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(i, sig) );
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(i, sig, pub) );
+		}
+
+		std::stringstream fp2(heads + mail + "Tampered\r\n");
+		Validatory myValidatory2(fp2);
+		size_t n = 0;
+		for (auto i = myValidatory2.GetSignatures().begin(); i != myValidatory2.GetSignatures().end(); ++i, ++n)
+		{
+			// only the signatures without a body length limit cover the change
+			DKIM::Signature sig;
+			if (n < 2)
+				CPPUNIT_ASSERT_THROW ( myValidatory2.GetSignature(i, sig), DKIM::PermanentError );
+			else
+				CPPUNIT_ASSERT_NO_THROW ( myValidatory2.GetSignature(i, sig) );
+		}
+	}
+	void SourceTest()
+	{
+		std::string mail = "From: erik@halon.se\r\nSubject: test\r\n\r\nHello  World \r\n\r\n";
+		SignatoryOptions options;
+		options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+		options.SetCanonModeHeader(DKIM::DKIM_C_RELAXED).SetCanonModeBody(DKIM::DKIM_C_RELAXED);
+
+		std::stringstream fp(mail);
+		std::string head;
+		CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+
+		// the same signature from memory and from a mapped file
+		std::string head2;
+		CPPUNIT_ASSERT_NO_THROW ( head2 = Signatory(mail.c_str(), mail.size()).CreateSignature(options) );
+		CPPUNIT_ASSERT ( head2 == head );
+
+		std::string signedMail = head + "\r\n" + mail;
+		char path[] = "/tmp/dkimtestXXXXXX";
+		int fd = mkstemp(path);
+		CPPUNIT_ASSERT ( fd != -1 );
+		unlink(path);
+		CPPUNIT_ASSERT ( write(fd, signedMail.c_str(), signedMail.size()) == (ssize_t)signedMail.size() );
+		Validatory myValidatory(fd);
+		close(fd);
+
+		const Validatory::SignatureList& siglist = myValidatory.GetSignatures();
+		CPPUNIT_ASSERT ( siglist.size() == 1 );
+
+		DKIM::PublicKey pub;
+		CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+		DKIM::Signature sig;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(siglist.begin(), sig) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(siglist.begin(), sig, pub) );
+
+		Validatory myValidatory2(signedMail.c_str(), signedMail.size());
+		CPPUNIT_ASSERT ( myValidatory2.GetSignatures().size() == 1 );
+		DKIM::Signature sig2;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory2.GetSignature(myValidatory2.GetSignatures().begin(), sig2) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory2.CheckSignature(myValidatory2.GetSignatures().begin(), sig2, pub) );
+
+		// chunks of 7 bytes, headers and CRLFs straddle them
+		std::vector<struct iovec> iov;
+		for (size_t i = 0; i < signedMail.size(); i += 7)
+			iov.push_back({ (void*)(signedMail.c_str() + i), std::min((size_t)7, signedMail.size() - i) });
+		Validatory myValidatory3(iov.data(), iov.size());
+		CPPUNIT_ASSERT ( myValidatory3.GetSignatures().size() == 1 );
+		DKIM::Signature sig3;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory3.GetSignature(myValidatory3.GetSignatures().begin(), sig3) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory3.CheckSignature(myValidatory3.GetSignatures().begin(), sig3, pub) );
+
+		std::vector<struct iovec> mailiov;
+		for (size_t i = 0; i < mail.size(); i += 5)
+			mailiov.push_back({ (void*)(mail.c_str() + i), std::min((size_t)5, mail.size() - i) });
+		std::string head3;
+		CPPUNIT_ASSERT_NO_THROW ( head3 = Signatory(mailiov.data(), mailiov.size()).CreateSignature(options) );
+		CPPUNIT_ASSERT ( head3 == head );
+		std::string head4;
+		CPPUNIT_ASSERT_NO_THROW ( head4 = Signatory([&mailiov] (size_t index, const char*& data, size_t& size) {
+				if (index >= mailiov.size())
+					return false;
+				data = (const char*)mailiov[index].iov_base;
+				size = mailiov[index].iov_len;
+				return true;
+			}).CreateSignature(options) );
+		CPPUNIT_ASSERT ( head4 == head );
+
+		// hashed in pipelined threads
+		DKIM::MessageSource source(mail.c_str(), mail.size());
+		source.SetPipelineThreshold(1);
+		std::string head5;
+		CPPUNIT_ASSERT_NO_THROW ( head5 = Signatory(source).CreateSignature(options) );
+		CPPUNIT_ASSERT ( head5 == head );
+
+		DKIM::MessageSource source2(signedMail.c_str(), signedMail.size());
+		source2.SetPipelineThreshold(1);
+		Validatory myValidatory4(source2);
+		DKIM::Signature sig4;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory4.GetSignature(myValidatory4.GetSignatures().begin(), sig4) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory4.CheckSignature(myValidatory4.GetSignatures().begin(), sig4, pub) );
+
+		// validators and signers on one source share the parsed (and canonicalized) header fields
+		Validatory myValidatory5(source2);
+		CPPUNIT_ASSERT ( myValidatory5.GetSignatures().front() == myValidatory4.GetSignatures().front() );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory5.CheckSignature(myValidatory5.GetSignatures().begin(), sig4, pub) );
+		std::string head6;
+		CPPUNIT_ASSERT_NO_THROW ( head6 = Signatory(source2).CreateSignature(options) );
+		std::stringstream fp6(head6 + "\r\n" + signedMail);
+		Validatory myValidatory6(fp6);
+		DKIM::Signature sig6;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory6.GetSignature(myValidatory6.GetSignatures().begin(), sig6) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory6.CheckSignature(myValidatory6.GetSignatures().begin(), sig6, pub) );
+	}
+	void DotStuffedTest()
+	{
+		std::string mail = "From: erik@halon.se\r\nSubject: test\r\n\r\n.Hello\r\n.\r\n\r\n";
+		std::string data = "From: erik@halon.se\r\nSubject: test\r\n\r\n..Hello\r\n..\r\n\r\n.\r\nTrailing\r\n";
+		for (int i = 0; i < 2; ++i)
+		{
+			SignatoryOptions options;
+			options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+			options.SetCanonModeBody(i ? DKIM::DKIM_C_RELAXED : DKIM::DKIM_C_SIMPLE);
+
+			std::stringstream fp(mail);
+			std::string head;
+			CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+
+			DKIM::MessageSource source(data.c_str(), data.size());
+			source.SetDotStuffed(true);
+			std::string head2;
+			CPPUNIT_ASSERT_NO_THROW ( head2 = Signatory(source).CreateSignature(options) );
+			CPPUNIT_ASSERT ( head2 == head );
+
+			std::string signedData = head + "\r\n" + data;
+			std::vector<struct iovec> iov;
+			for (size_t n = 0; n < signedData.size(); n += 3)
+				iov.push_back({ (void*)(signedData.c_str() + n), std::min((size_t)3, signedData.size() - n) });
+			DKIM::MessageSource source2(iov.data(), iov.size());
+			source2.SetDotStuffed(true);
+			Validatory myValidatory(source2);
+			CPPUNIT_ASSERT ( myValidatory.GetSignatures().size() == 1 );
+
+			DKIM::PublicKey pub;
+			CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+			DKIM::Signature sig;
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(myValidatory.GetSignatures().begin(), sig) );
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(myValidatory.GetSignatures().begin(), sig, pub) );
+		}
+	}
+	void LineEndingTest()
+	{
+		std::string mail = "From: erik@halon.se\r\nSubject: test\r\n folded\r\n\r\nHello  World \r\n\r\n";
+		std::string lfmail = "From: erik@halon.se\nSubject: test\n folded\n\nHello  World \n\n";
+		for (int i = 0; i < 2; ++i)
+		{
+			SignatoryOptions options;
+			options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+			options.SetCanonModeHeader(i ? DKIM::DKIM_C_RELAXED : DKIM::DKIM_C_SIMPLE);
+			options.SetCanonModeBody(i ? DKIM::DKIM_C_RELAXED : DKIM::DKIM_C_SIMPLE);
+
+			std::stringstream fp(mail);
+			std::string head;
+			CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+
+			// the same signature, with LF line endings
+			DKIM::MessageSource source(lfmail.c_str(), lfmail.size());
+			source.SetLineEnding(DKIM::DKIM_LE_AUTO);
+			std::string lfhead;
+			CPPUNIT_ASSERT_NO_THROW ( lfhead = Signatory(source).CreateSignature(options) );
+			CPPUNIT_ASSERT ( lfhead.find('\r') == std::string::npos );
+			std::string::size_type crlf;
+			while ((crlf = head.find("\r\n")) != std::string::npos)
+				head.erase(crlf, 1);
+			CPPUNIT_ASSERT ( lfhead == head );
+
+			std::string signedMail = lfhead + "\n" + lfmail;
+			DKIM::MessageSource source2(signedMail.c_str(), signedMail.size());
+			source2.SetLineEnding(DKIM::DKIM_LE_LF);
+			Validatory myValidatory(source2);
+			CPPUNIT_ASSERT ( myValidatory.GetSignatures().size() == 1 );
+
+			DKIM::PublicKey pub;
+			CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+			DKIM::Signature sig;
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(myValidatory.GetSignatures().begin(), sig) );
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(myValidatory.GetSignatures().begin(), sig, pub) );
+		}
+	}
+	void LimitTest()
+	{
+		std::string mail = "From: erik@halon.se\r\n\r\nHello  World \r\n\r\n";
+		SignatoryOptions options;
+		options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+		options.SetOversignHeaders({ "from" });
+		std::stringstream fp(mail);
+		std::string head;
+		CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+		std::string signedMail = head + "\r\n" + head + "\r\n" + head + "\r\n" + mail;
+
+		// the signatures beyond the limit are not evaluated
+		DKIM::MessageSource source(signedMail.c_str(), signedMail.size());
+		source.SetLimits(DKIM::Limits().SetMaxSignatures(2));
+		Validatory myValidatory(source);
+		CPPUNIT_ASSERT ( myValidatory.GetSignatures().size() == 2 );
+
+		DKIM::Signature sig;
+		DKIM::MessageSource source2(signedMail.c_str(), signedMail.size());
+		source2.SetLimits(DKIM::Limits().SetMaxSignedHeaders(0));
+		Validatory myValidatory2(source2);
+		CPPUNIT_ASSERT ( myValidatory2.GetSignatures().size() == 3 );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory2.GetSignature(myValidatory2.GetSignatures().begin(), sig) );
+
+		DKIM::Signature sig2;
+		// the settings of a parsed source can not change until it is reset
+		CPPUNIT_ASSERT_THROW ( source2.SetLimits(DKIM::Limits().SetMaxSignedHeaders(1)), std::logic_error );
+		CPPUNIT_ASSERT_THROW ( source2.SetDotStuffed(true), std::logic_error );
+		CPPUNIT_ASSERT_THROW ( source2.SetLineEnding(DKIM::DKIM_LE_LF), std::logic_error );
+		source2.Reset(signedMail.c_str(), signedMail.size());
+		source2.SetLimits(DKIM::Limits().SetMaxSignedHeaders(1));
+		myValidatory2.Reset(source2);
+		CPPUNIT_ASSERT ( myValidatory2.GetSignatures().size() == 3 );
+		CPPUNIT_ASSERT_THROW ( myValidatory2.GetSignature(myValidatory2.GetSignatures().begin(), sig2), DKIM::LimitError );
+
+		source2.Reset(signedMail.c_str(), signedMail.size());
+		source2.SetLimits(DKIM::Limits().SetMaxHeaderCount(3));
+		CPPUNIT_ASSERT_THROW ( myValidatory2.Reset(source2), DKIM::LimitError );
+
+		// the sources of the convenience constructors have the default
+		// limits, other limits may be given
+		std::string large;
+		for (size_t i = 0; i <= DKIM::Limits::DefaultMaxHeaderCount; ++i)
+			large += "Received: from a by b\r\n";
+		large += mail;
+		DKIM::Limits lifted = DKIM::Limits().SetMaxHeaderCount(0);
+		std::stringstream fp2(large);
+		CPPUNIT_ASSERT_THROW ( Signatory(fp2).CreateSignature(options), DKIM::LimitError );
+		std::stringstream fp3(large);
+		CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp3, lifted).CreateSignature(options) );
+		signedMail = head + "\r\n" + large;
+
+		DKIM::PublicKey pub;
+		CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+		CPPUNIT_ASSERT_THROW ( Validatory(signedMail.c_str(), signedMail.size()), DKIM::LimitError );
+		Validatory myValidatory3(signedMail.c_str(), signedMail.size(), Validatory::DKIM, lifted);
+		DKIM::Signature sig3;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory3.GetSignature(myValidatory3.GetSignatures().begin(), sig3) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory3.CheckSignature(myValidatory3.GetSignatures().begin(), sig3, pub) );
+
+		// Reset() sets the limits again
+		Signatory mySignatory(fp);
+		std::stringstream fp4(large);
+		mySignatory.Reset(fp4);
+		CPPUNIT_ASSERT_THROW ( mySignatory.CreateSignature(options), DKIM::LimitError );
+		std::stringstream fp5(large);
+		mySignatory.Reset(fp5, lifted);
+		CPPUNIT_ASSERT_NO_THROW ( mySignatory.CreateSignature(options) );
+	}
+	void LazyTest()
+	{
+		std::string mail = "From: erik@halon.se\r\nSubject: test\r\n\r\nHello World\r\n";
+		SignatoryOptions options;
+		options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+
+		std::stringstream fp(mail);
+		std::string head;
+		CPPUNIT_ASSERT_NO_THROW ( head = Signatory(fp).CreateSignature(options) );
+		size_t h = head.find("\th=");
+		CPPUNIT_ASSERT ( h != std::string::npos );
+		size_t end = head.find(';', h);
+		CPPUNIT_ASSERT ( end != std::string::npos );
+
+		DKIM::PublicKey pub;
+		CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+
+		// h= is checked for From: before it is decoded
+		std::string unsignedFrom = head;
+		unsignedFrom.replace(h + 3, end - h - 3, "subject");
+		std::string signedMail = unsignedFrom + "\r\n" + mail;
+		Validatory myValidatory(signedMail.c_str(), signedMail.size());
+		DKIM::Signature sig;
+		CPPUNIT_ASSERT_THROW ( myValidatory.GetSignature(myValidatory.GetSignatures().begin(), sig), DKIM::PermanentError );
+		CPPUNIT_ASSERT_THROW ( myValidatory.CheckSignature(myValidatory.GetSignatures().begin(), sig, pub), DKIM::PermanentError );
+
+		std::string foldedFrom = head;
+		foldedFrom.replace(h + 3, end - h - 3, "subject :\r\n\tFROM ");
+		signedMail = foldedFrom + "\r\n" + mail;
+		Validatory myValidatory3(signedMail.c_str(), signedMail.size());
+		DKIM::Signature sig3;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory3.GetSignature(myValidatory3.GetSignatures().begin(), sig3) );
+		CPPUNIT_ASSERT ( sig3.GetSignedHeaders().size() == 2 );
+		CPPUNIT_ASSERT ( sig3.GetSignedHeaders()[1] == "FROM" );
+
+		// the decoded values are cached
+		signedMail = head + "\r\n" + mail;
+		Validatory myValidatory2(signedMail.c_str(), signedMail.size());
+		DKIM::Signature sig2;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory2.GetSignature(myValidatory2.GetSignatures().begin(), sig2) );
+		CPPUNIT_ASSERT ( sig2.GetSignedHeaders().size() >= 2 );
+		CPPUNIT_ASSERT ( &sig2.GetSignatureData() == &sig2.GetSignatureData() );
+		CPPUNIT_ASSERT ( !sig2.GetSignatureData().empty() );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory2.CheckSignature(myValidatory2.GetSignatures().begin(), sig2, pub) );
+	}
+	void ReuseTest()
+	{
+		SignatoryOptions options;
+		options.SetPrivateKey(DKIM_PRIVATEKEY).SetDomain("halon.se").SetSelector("dkim-test");
+		options.SetCanonModeBody(DKIM::DKIM_C_RELAXED).SetCanonModeHeader(DKIM::DKIM_C_RELAXED);
+
+		DKIM::PublicKey pub;
+		CPPUNIT_ASSERT_NO_THROW ( pub.Parse("v=DKIM1; p=" DKIM_PUBLICKEY) );
+
+		// one signer and one validator for all messages, of each input type
+		std::string first = "From: erik@halon.se\r\nSubject: first\r\n\r\nHello World\r\n";
+		Signatory mySignatory(first.c_str(), first.size());
+		Validatory myValidatory(first.c_str(), first.size());
+		CPPUNIT_ASSERT ( myValidatory.GetSignatures().empty() );
+		for (int i = 0; i < 8; ++i)
+		{
+			std::string mail = "From: erik@halon.se\r\nSubject: message " + std::to_string(i) + "\r\n"
+				+ std::string(i * 1000, 'x') + "\r\n\r\nbody " + std::to_string(i) + "\r\n";
+			std::string head;
+			std::stringstream fp(mail);
+			if (i % 2)
+				mySignatory.Reset(fp);
+			else
+				mySignatory.Reset(mail.c_str(), mail.size());
+			CPPUNIT_ASSERT_NO_THROW ( head = mySignatory.CreateSignature(options) );
+
+			std::string signedMail = head + "\r\n" + mail;
+			struct iovec iov[2] = {
+				{ (void*)signedMail.c_str(), signedMail.size() / 2 },
+				{ (void*)(signedMail.c_str() + signedMail.size() / 2), signedMail.size() - signedMail.size() / 2 },
+			};
+			if (i % 2)
+				myValidatory.Reset(iov, 2);
+			else
+				myValidatory.Reset(signedMail.c_str(), signedMail.size());
+			CPPUNIT_ASSERT ( myValidatory.GetSignatures().size() == 1 );
+
+			DKIM::Signature sig(myValidatory.GetResource());
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(myValidatory.GetSignatures().begin(), sig) );
+			CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(myValidatory.GetSignatures().begin(), sig, pub) );
+		}
+
+		// a shared source is reset by its owner
+		std::string mail = "From: erik@halon.se\r\n\r\nshared\r\n";
+		DKIM::MessageSource source;
+		source.Reset(mail.c_str(), mail.size());
+		std::string head;
+		mySignatory.Reset(source);
+		CPPUNIT_ASSERT_NO_THROW ( head = mySignatory.CreateSignature(options) );
+		std::string signedMail = head + "\r\n" + mail;
+		source.Reset(signedMail.c_str(), signedMail.size());
+		myValidatory.Reset(source);
+		CPPUNIT_ASSERT ( myValidatory.GetSignatures().size() == 1 );
+		DKIM::Signature sig;
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory.GetSignature(myValidatory.GetSignatures().begin(), sig) );
+		CPPUNIT_ASSERT_NO_THROW ( myValidatory.CheckSignature(myValidatory.GetSignatures().begin(), sig, pub) );
+	}
 	void _SignMailTest(const SignatoryOptions& options, const std::string& mail)
 	{
 		std::string head;
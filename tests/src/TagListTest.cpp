@@ -9,6 +9,8 @@ using DKIM::TagListEntry;
 class TagListTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( TagListTest );
 	CPPUNIT_TEST( ParseTest );
+	CPPUNIT_TEST( ViewTest );
+	CPPUNIT_TEST( NameTest );
 	CPPUNIT_TEST_SUITE_END();
 	public:
 	void setUp() { }
@@ -70,6 +72,84 @@ class TagListTest : public CppUnit::TestFixture {
 		CPPUNIT_ASSERT ( myEntry.GetValue() == "BAZ" );
 		CPPUNIT_ASSERT ( myEntry.GetLCaseValue() == "baz" );
 	}
+	void ViewTest()
+	{
+		TagList myTag;
+		std::string error;
+
+		try { myTag.Parse("v=1; a\x01"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid tag list; unexpected 0x1, expecting = at position 6" );
+		myTag.Reset();
+		try { myTag.Parse("v=1; a"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid tag list; unexpected 0xff, expecting = at position -1" );
+		myTag.Reset();
+		try { myTag.Parse("v=1; =2"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid tag name (empty), expecting name at position 5" );
+		myTag.Reset();
+		try { myTag.Parse("v=1 \x7f"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Invalid tag value (invalid data), unexpected 0x7f at position 4" );
+		myTag.Reset();
+		try { myTag.Parse("v=1; v=2"); } catch (std::exception& e) { error = e.what(); }
+		CPPUNIT_ASSERT ( error == "Duplicate tag name (v)" );
+
+		// the values are views of the list, whitespace within them is kept
+		myTag.Reset();
+		std::string input = "a=1; b = x \r\n y ;c=";
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse(input) );
+		const TagListEntry* b = myTag.GetTag("b");
+		CPPUNIT_ASSERT ( b && b->GetName() == "b" && b->GetValue() == "x \r\n y" );
+		CPPUNIT_ASSERT ( input.substr((size_t)b->GetValueOffset(), b->GetValue().size()) == "x \r\n y" );
+		CPPUNIT_ASSERT ( myTag.GetTag("c")->GetValueOffset() == -1 );
+		CPPUNIT_ASSERT ( myTag.GetTag("d") == nullptr );
+
+		// more tags than are inline, and a second list whose names are checked against the first
+		myTag.Reset();
+		std::string many;
+		for (char c = 'a'; c <= 'z'; ++c)
+			many += std::string(1, c) + "=" + std::string(1, (char)(c - 'a' + 'A')) + ";";
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse(many) );
+		CPPUNIT_ASSERT ( myTag.cend() - myTag.cbegin() == 26 );
+		CPPUNIT_ASSERT ( myTag.GetTag("a")->GetValue() == "A" );
+		CPPUNIT_ASSERT ( myTag.GetTag("z")->GetValue() == "Z" );
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse(std::string(1000, ' ') + "A=1") );
+		CPPUNIT_ASSERT ( myTag.GetTag("a")->GetValue() == "A" );
+		CPPUNIT_ASSERT ( myTag.GetTag("A")->GetValue() == "1" );
+		CPPUNIT_ASSERT ( myTag.GetTag("A")->GetValueOffset() == 1002 );
+		CPPUNIT_ASSERT_THROW ( myTag.Parse("z=1"), std::runtime_error );
+	}
+	void NameTest()
+	{
+		CPPUNIT_ASSERT ( DKIM::TagName::Lookup("bh") == DKIM::TagName::BH );
+		CPPUNIT_ASSERT ( DKIM::TagName::Lookup("cv") == DKIM::TagName::CV );
+		CPPUNIT_ASSERT ( DKIM::TagName::Name(DKIM::TagName::Z) == "z" );
+		CPPUNIT_ASSERT ( DKIM::TagName::Lookup("B") == DKIM::TagName::UNKNOWN );
+		CPPUNIT_ASSERT ( DKIM::TagName::Lookup("bhh") == DKIM::TagName::UNKNOWN );
+		CPPUNIT_ASSERT ( DKIM::TagName::Lookup("") == DKIM::TagName::UNKNOWN );
+		CPPUNIT_ASSERT ( DKIM::TagValue::Lookup("rsa-sha256") == DKIM::TagValue::RSA_SHA256 );
+		CPPUNIT_ASSERT ( DKIM::TagValue::Lookup("*") == DKIM::TagValue::ANY );
+		CPPUNIT_ASSERT ( DKIM::TagValue::Lookup("RSA-SHA256") == DKIM::TagValue::UNKNOWN );
+		CPPUNIT_ASSERT ( DKIM::TagValue::Lookup("dkim1") == DKIM::TagValue::UNKNOWN );
+
+		// the known names are found by id, also beyond the inline tags
+		TagList myTag;
+		std::string many;
+		for (char c = 'a'; c <= 'z'; ++c)
+			many += std::string(1, c) + "=" + std::string(1, (char)(c - 'a' + 'A')) + ";";
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse(many + "bh=1; X_y=2") );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::A)->GetValue() == "A" );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::Z)->GetValue() == "Z" );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::BH)->GetValue() == "1" );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::CV) == nullptr );
+		CPPUNIT_ASSERT_THROW ( myTag.Parse("bh=2"), std::runtime_error );
+		myTag.Reset();
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::A) == nullptr );
+
+		// names that only differ in case replace the tag
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse("V=1; H=2", false) );
+		CPPUNIT_ASSERT_NO_THROW ( myTag.Parse("V=3", false) );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::V)->GetValue() == "3" );
+		CPPUNIT_ASSERT ( myTag.GetTag(DKIM::TagName::H)->GetValue() == "2" );
+	}
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION( TagListTest );
@@ -70,10 +70,26 @@ class TokenizerTest : public CppUnit::TestFixture {
 			CPPUNIT_ASSERT ( ReadWhiteSpace(input, ::READ_FWS) == "\r\n " );
 			CPPUNIT_ASSERT_THROW ( ReadWhiteSpace(input, ::READ_FWS), std::runtime_error );
 		}
+		{
+			std::stringstream input("\t \r\n \t\r\n x");
+			CPPUNIT_ASSERT ( ReadWhiteSpace(input, ::READ_FWS) == "\t \r\n \t" );
+			CPPUNIT_ASSERT ( ReadWhiteSpace(input, ::READ_FWS) == "\r\n " );
+			CPPUNIT_ASSERT ( input.get() == 'x' );
+		}
+		{
+			// whitespace before CRLF that is not folded is read once
+			std::string value = "a" + std::string(100000, ' ') + "\r\nb";
+			auto values = ValueList(value);
+			CPPUNIT_ASSERT ( values.size() == 1 );
+			CPPUNIT_ASSERT ( values.front() == value );
+			std::list<std::string> list = ParseAddressList(value);
+			CPPUNIT_ASSERT ( list.size() == 1 );
+			CPPUNIT_ASSERT ( list.front() == value );
+		}
 	}
 	void testValueList()
 	{
-		std::list<std::string> result;
+		std::pmr::vector<std::string_view> result;
 
 		CPPUNIT_ASSERT ( ValueList("").size() == 0 );
 		CPPUNIT_ASSERT ( ValueList("a").size() == 1 );
@@ -84,16 +100,23 @@ class TokenizerTest : public CppUnit::TestFixture {
 		result.clear();
 		CPPUNIT_ASSERT_NO_THROW ( result = ValueList(" a : b : a b : a b:b") );
 		CPPUNIT_ASSERT ( result.size() == 5 );
-		CPPUNIT_ASSERT ( *(result.begin()) == "a" );
-		result.pop_front();
-		CPPUNIT_ASSERT ( *(result.begin()) == "b" );
-		result.pop_front();
-		CPPUNIT_ASSERT ( *(result.begin()) == "a b" );
-		result.pop_front();
-		CPPUNIT_ASSERT ( *(result.begin()) == "a b" );
-		result.pop_front();
-		CPPUNIT_ASSERT ( *(result.begin()) == "b" );
-		result.pop_front();
+		CPPUNIT_ASSERT ( result[0] == "a" );
+		CPPUNIT_ASSERT ( result[1] == "b" );
+		CPPUNIT_ASSERT ( result[2] == "a b" );
+		CPPUNIT_ASSERT ( result[3] == "a b" );
+		CPPUNIT_ASSERT ( result[4] == "b" );
+
+		// the values are views of the input, folded whitespace within them is kept
+		std::string input = "from \r\n\t: to\r\n :\r\n sub\r\n ject \t";
+		CPPUNIT_ASSERT_NO_THROW ( result = ValueList(input) );
+		CPPUNIT_ASSERT ( result.size() == 3 );
+		CPPUNIT_ASSERT ( result[0] == "from" && result[0].data() == input.data() );
+		CPPUNIT_ASSERT ( result[1] == "to" );
+		CPPUNIT_ASSERT ( result[2] == "sub\r\n ject" );
+		CPPUNIT_ASSERT ( ValueList("a\r\nb:c")[0] == "a\r\nb" );
+		CPPUNIT_ASSERT_THROW ( ValueList("a\rb"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( ValueList("a \r"), std::runtime_error );
+		CPPUNIT_ASSERT_THROW ( ValueList("a: \r\n :b"), std::runtime_error );
 	}
 	void testAddressList()
 	{
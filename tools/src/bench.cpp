@@ -0,0 +1,342 @@
+#include "Canonicalization.hpp"
+#include "BodyHash.hpp"
+#include "MailParser.hpp"
+#include "Tokenizer.hpp"
+#include "TagList.hpp"
+#include "Signature.hpp"
+#include "Base64.hpp"
+
+using DKIM::Conversion::BodyCanonicalizer;
+using DKIM::Conversion::CanonicalizationHeader;
+using DKIM::Conversion::BodyHash;
+using DKIM::Message;
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <algorithm>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+
+extern char *__progname;
+
+void usage(FILE* fp, int status)
+{
+	fprintf(fp,
+			"\n"
+			" libdkimbench build on " __DATE__ " (c) Halon Security <support@halon.se>\n"
+			"\n"
+			" %s [ options ]\n"
+			"\n"
+			" Options\n"
+			"\n"
+			" -h,  --help       Show this help\n"
+			" -n,  --rounds     <rounds> (default: 20)\n"
+			"\n"
+			, __progname
+			);
+	exit(status);
+}
+
+/*
+ * Run func rounds times and print the throughput over size bytes
+ */
+template <typename F>
+void bench(const char* name, size_t size, unsigned long rounds, F func)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < rounds; ++i)
+		func();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	printf("%-24s %10.1f MB/s %10.2f ns/byte\n", name,
+			(double)size * (double)rounds / elapsed.count() / 1e6,
+			elapsed.count() * 1e9 / ((double)size * (double)rounds));
+}
+
+std::string MakeBody(size_t size)
+{
+	const char* lines[] = {
+		"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod\r\n",
+		"tempor incididunt ut labore et dolore magna aliqua.  Ut enim ad minim \r\n",
+		"\r\n",
+		"\tveniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex\r\n",
+		"PGh0bWw+PGJvZHk+PHA+SGVsbG8gV29ybGQ8L3A+PC9ib2R5PjwvaHRtbD4KPGh0bWw+PGJv\r\n",
+	};
+	std::string body;
+	for (size_t i = 0; body.size() < size; ++i)
+		body += lines[i % (sizeof lines / sizeof *lines)];
+	return body;
+}
+
+/*
+ * Adversarial whitespace of about size bytes: runs of WSP before a CRLF
+ * that is not folded, folded lines, and CRLF and WSP alternating
+ */
+std::string MakeWhiteSpace(size_t size, int kind)
+{
+	const char* patterns[] = {
+		"\r\nx",
+		"\r\n\tx",
+		" \r\n \r\n\tx",
+	};
+	std::string data = "x";
+	while (data.size() < size)
+	{
+		if (kind != 2)
+			data.append(1024, kind == 0 ? ' ' : '\t');
+		data += patterns[kind];
+	}
+	return data;
+}
+
+/*
+ * The OpenSSL BIO chain that Base64 used before, for comparison
+ */
+std::string Base64_DecodeBIO(const std::string& data)
+{
+	BIO *i, *o, *l;
+	i = BIO_new(BIO_f_base64());
+	BIO_set_flags(i, BIO_FLAGS_BASE64_NO_NL);
+	o = BIO_new(BIO_s_mem());
+	l = BIO_push(i, o);
+	BIO_write(o, data.c_str(), (int)data.size());
+	(void) BIO_flush(o);
+
+	char b[1024];
+	int r;
+	std::string result;
+	while ((r = BIO_read(l, b, sizeof b)) > 0)
+		result.append(b, (size_t)r);
+
+	BIO_free_all(l);
+	return result;
+}
+
+std::string Base64_EncodeBIO(const std::string& data)
+{
+	BIO *i, *o, *l;
+	i = BIO_new(BIO_f_base64());
+	o = BIO_new(BIO_s_mem());
+	l = BIO_push(i, o);
+	BIO_set_flags(l, BIO_FLAGS_BASE64_NO_NL);
+	BIO_write(l, data.c_str(), (int)data.size());
+	(void) BIO_flush(l);
+	std::string str;
+
+	char buf[256];
+	int r;
+	while ((r = BIO_read(o, buf, sizeof buf)) > 0)
+	{
+		if (buf[r - 1] == '\n') --r;
+		str.append(buf, (size_t)r);
+	}
+
+	BIO_free_all(l);
+	return str;
+}
+
+int main(int argc, char* argv[])
+{
+	__progname = argv[0];
+
+	unsigned long rounds = 20;
+
+	static struct option longopts[] = {
+		{ "help",		no_argument,		nullptr,		'h'	},
+		{ "rounds",		required_argument,	nullptr,		'n'	},
+		{ nullptr,			0,					nullptr,		0	}
+	};
+
+	opterr = 0;
+	optind = 0;
+	int ch;
+	while ((ch = getopt_long(argc, argv, "hn:", longopts, nullptr)) != -1) {
+		switch (ch)
+		{
+			case 'h':
+				usage(stdout, 0);
+				break;
+			case 'n':
+				rounds = strtoul(optarg, nullptr, 10);
+				break;
+			default:
+				usage(stderr, 2);
+				break;
+		}
+	}
+
+	size_t total = 0;
+	auto sink = [&total] (const char*, size_t size) { total += size; };
+
+	std::string body = MakeBody(4 * 1024 * 1024);
+	struct { const char* name; DKIM::CanonMode type; bool bodyLimit; } bodies[] = {
+		{ "body simple", DKIM::DKIM_C_SIMPLE, false },
+		{ "body relaxed", DKIM::DKIM_C_RELAXED, false },
+		{ "body simple l=", DKIM::DKIM_C_SIMPLE, true },
+		{ "body relaxed l=", DKIM::DKIM_C_RELAXED, true },
+	};
+	for (const auto & b : bodies)
+	{
+		bench(b.name, body.size(), rounds, [&] () {
+			BodyCanonicalizer canonicalbody(b.type, b.bodyLimit, body.size(), sink);
+			for (size_t i = 0; i < body.size(); i += 8096)
+				canonicalbody.Update(body.c_str() + i, std::min((size_t)8096, body.size() - i));
+			canonicalbody.Final();
+		});
+	}
+
+	// all body hashes of a message signed in both modes with both algorithms
+	struct { const char* name; bool pipelined; } hashes[] = {
+		{ "bodyhash x4", false },
+		{ "bodyhash x4 pipelined", true },
+	};
+	for (const auto & h : hashes)
+	{
+		bench(h.name, body.size(), rounds, [&] () {
+			BodyHash bodyHash;
+			bodyHash.SetPipelined(h.pipelined);
+			const DKIM::CanonMode types[] = { DKIM::DKIM_C_SIMPLE, DKIM::DKIM_C_RELAXED };
+			const DKIM::DigestAlgorithm algorithms[] = { DKIM::DKIM_A_SHA1, DKIM::DKIM_A_SHA256 };
+			for (auto type : types)
+				for (auto algorithm : algorithms)
+					bodyHash.Add(type, algorithm, false, 0);
+			for (size_t i = 0; i < body.size(); i += 8096)
+				bodyHash.Update(body.c_str() + i, std::min((size_t)8096, body.size() - i));
+			bodyHash.Final();
+		});
+	}
+
+	std::vector<std::string> headers = {
+		"From: \"Erik Lax\" <erik@halon.se>",
+		"To: support@halon.se,\r\n\tsales@halon.se",
+		"Subject: A rather long subject line that is   folded\r\n over two lines",
+		"Date: Fri, 16 Oct 2026 10:00:00 +0200",
+		"Message-ID: <20261016100000.12345@mail.halon.se>",
+		"Content-Type: multipart/alternative;\r\n boundary=\"----=_Part_12345_67890.1602835200000\"",
+	};
+	size_t headerSize = 0;
+	for (const auto & h : headers)
+		headerSize += h.size();
+	struct { const char* name; DKIM::CanonMode type; bool write; } heads[] = {
+		{ "header simple", DKIM::DKIM_C_SIMPLE, false },
+		{ "header relaxed", DKIM::DKIM_C_RELAXED, false },
+		{ "header simple write", DKIM::DKIM_C_SIMPLE, true },
+		{ "header relaxed write", DKIM::DKIM_C_RELAXED, true },
+	};
+	auto count = [&total] (const char*, size_t size) { total += size; };
+	for (const auto & h : heads)
+	{
+		CanonicalizationHeader canonicalhead(h.type);
+		bench(h.name, headerSize, rounds * 10000, [&] () {
+			for (const auto & header : headers)
+			{
+				if (h.write)
+					canonicalhead.WriteHeader(header, count, true);
+				else
+					total += canonicalhead.FilterHeader(header).size();
+			}
+		});
+	}
+
+	// the header of a message with a body, parsed in full or scanned for the signatures
+	std::string mail;
+	for (size_t i = 0; i < 10; ++i)
+		for (const auto & h : headers)
+			mail += h + "\r\n";
+	mail += "DKIM-Signature: v=1; a=rsa-sha256; d=halon.se; s=dkim-test;\r\n\th=from:to:subject; bh=; b=\r\n";
+	size_t mailHeaderSize = mail.size();
+	mail += "\r\n" + body.substr(0, 64 * 1024);
+	const std::vector<std::string_view> names = { "dkim-signature", "arc-*", "from" };
+	struct { const char* name; bool scan; } parses[] = {
+		{ "message parse", false },
+		{ "message scan", true },
+	};
+	for (const auto & p : parses)
+	{
+		bench(p.name, mailHeaderSize, rounds * 1000, [&] () {
+			Message msg;
+			if (p.scan)
+				msg.Scan(mail.c_str(), mail.size(), names);
+			else
+				msg.Parse(mail.c_str(), mail.size());
+			total += msg.GetHeaders().size();
+		});
+	}
+
+	// base64 of a b= value (2048 bit RSA) and of a larger block, folded as in a
+	// header; the BIO chain needs the whitespace removed first
+	for (size_t size : { 256, 64 * 1024 })
+	{
+		std::string raw = body.substr(0, size);
+		std::string encoded = DKIM::Conversion::Base64_Encode(raw);
+		std::string folded;
+		for (size_t i = 0; i < encoded.size(); i += 72)
+			folded += (i ? "\r\n\t" : "") + encoded.substr(i, 72);
+		std::string suffix = size < 1024 ? " " + std::to_string(size) : " " + std::to_string(size / 1024) + "k";
+		unsigned long n = rounds * (size < 1024 ? 100000 : 100);
+		bench(("base64 encode bio" + suffix).c_str(), raw.size(), n, [&] () {
+			total += Base64_EncodeBIO(raw).size();
+		});
+		bench(("base64 encode" + suffix).c_str(), raw.size(), n, [&] () {
+			total += DKIM::Conversion::Base64_Encode(raw).size();
+		});
+		bench(("base64 decode bio" + suffix).c_str(), folded.size(), n, [&] () {
+			std::string tmp(folded);
+			tmp.erase(std::remove_if(tmp.begin(), tmp.end(), isspace), tmp.end());
+			total += Base64_DecodeBIO(tmp).size();
+		});
+		std::string out(DKIM::Conversion::Base64_DecodedSize(folded.size()), '\0');
+		bench(("base64 decode" + suffix).c_str(), folded.size(), n, [&] () {
+			total += DKIM::Conversion::Base64_Decode(folded, &out[0]);
+		});
+	}
+
+	// the policy tags of a signature, the b, bh and h tags are only decoded when checked
+	Message signed_;
+	std::string signature = "DKIM-Signature: v=1; a=rsa-sha256; c=relaxed/relaxed; d=halon.se;\r\n"
+		"\ts=dkim-test; t=1602835200; l=1024; q=dns/txt; i=erik@mail.halon.se;\r\n"
+		"\th=from:to:subject:date:message-id:content-type;\r\n"
+		"\tbh=47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=;\r\n"
+		"\tb=" + std::string(172, 'A') + "\r\n\r\n";
+	signed_.Parse(signature.c_str(), signature.size());
+	const DKIM::Header& signatureHeader = *signed_.GetHeaders().front();
+	bench("signature parse", signature.size(), rounds * 10000, [&] () {
+		DKIM::Signature sig;
+		sig.Parse(signatureHeader);
+		total += sig.GetBodySize();
+	});
+
+	// the cost per byte of pathological whitespace is the same at any size
+	const char* kinds[] = { "wsp-crlf", "wsp-fold", "crlf-wsp" };
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		for (size_t size : { 64 * 1024, 256 * 1024, 1024 * 1024 })
+		{
+			std::string data = MakeWhiteSpace(size, kind);
+			std::string name;
+			name = std::string("fws list ") + kinds[kind] + " " + std::to_string(size / 1024) + "k";
+			bench(name.c_str(), data.size(), rounds, [&] () {
+				total += DKIM::Tokenizer::ValueList(data).size();
+			});
+			name = std::string("fws tags ") + kinds[kind] + " " + std::to_string(size / 1024) + "k";
+			std::string tags = "v=" + data + ";";
+			bench(name.c_str(), tags.size(), rounds, [&] () {
+				DKIM::TagList tagList;
+				tagList.Parse(tags);
+				total += 1;
+			});
+			name = std::string("fws header ") + kinds[kind] + " " + std::to_string(size / 1024) + "k";
+			std::string header = "Subject:" + data;
+			CanonicalizationHeader canonicalhead(DKIM::DKIM_C_RELAXED);
+			bench(name.c_str(), header.size(), rounds, [&] () {
+				total += canonicalhead.FilterHeader(header).size();
+			});
+		}
+	}
+
+	return total == 0;
+}
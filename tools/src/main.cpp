@@ -175,8 +175,8 @@ int main(int argc, char* argv[])
 		for (Validatory::SignatureList::const_iterator i = mail.GetSignatures().begin();
 				i != mail.GetSignatures().end(); ++i)
 		{
-			DKIM::PublicKey pub;
-			DKIM::Signature sig;
+			DKIM::PublicKey pub(mail.GetResource());
+			DKIM::Signature sig(mail.GetResource());
 			try {
 				mail.GetSignature(i, sig);
 				mail.GetPublicKey(sig, pub);